@@ -0,0 +1,388 @@
+#ifndef PUBSUBCPP_CAPTURE_HPP
+#define PUBSUBCPP_CAPTURE_HPP
+
+#include "topic.hpp"
+#include <cstdio>
+#include <cinttypes>
+
+// Capture log of topic messages: a directory of preallocated, memory-mapped segment files,
+// a sparse index and the list of recorded topics.
+//
+//   topics.txt      - "id msg_size name" per line
+//   seg-NNNNNN.clap - SegmentHeader, then records; finished segments are cut to their used size
+//   index.clap      - IndexEntry at the start of every segment and every `index_every` records
+namespace tpc {
+    namespace capture {
+        static const uint64_t MAGIC = 0x3150414350414c43ull;   // "CLAPCAP1"
+        static const ui HEADER_SIZE = 64;
+
+        struct SegmentHeader {
+            uint64_t magic;
+            ui segment;
+            std::atomic<ui> used;       // bytes of complete records after the header, stored last
+            std::atomic<ui> records;
+            int64_t first_ns, last_ns;  // publish times of the first and the last record
+            std::atomic<ui> finished;   // no more records will come, the next segment follows
+        };
+        static_assert(sizeof(SegmentHeader) <= HEADER_SIZE, "Capture segment header doesn't fit");
+
+        // Followed by `size` bytes of the message, padded to 8 bytes
+        struct Record {
+            uint32_t topic;
+            uint32_t size;
+            ui seq;                     // sequence number of the message in its topic
+            int64_t time_ns;            // publish time, CLOCK_REALTIME
+        };
+
+        // All records before `record` were published before `time_ns`, so replay from a time
+        // starts at the last entry with an earlier time_ns and skips the few older records after it
+        struct IndexEntry {
+            int64_t time_ns;
+            ui record;                  // number of the record in the whole log
+            ui segment;
+            ui offset;                  // of the record in its segment file
+        };
+
+        ui record_size(ui size) {
+            return (sizeof(Record) + size + 7) & ~(ui) 7;
+        }
+
+        std::string segment_path(const std::string &dir, ui segment) {
+            char name[32];
+            snprintf(name, sizeof(name), "/seg-%06lu.clap", segment);
+            return dir + name;
+        }
+
+        std::string index_path(const std::string &dir) {
+            return dir + "/index.clap";
+        }
+
+        std::string topics_path(const std::string &dir) {
+            return dir + "/topics.txt";
+        }
+    }
+
+    // Appends batches of topic messages to a capture log. Several threads may append; every batch
+    // takes the log lock once. The next segment is created and preallocated in the background while
+    // the current one fills up, so rolling over doesn't stall recording.
+    class CaptureWriter {
+    public:
+        using Ptr = std::shared_ptr<CaptureWriter>;
+
+        static Ptr create(const std::string &dir, ui segment_size = 256ul << 20, ui index_every = 1024) {
+            if (segment_size <= capture::HEADER_SIZE || 0 == index_every) return nullptr;
+            if (-1 == mkdir(dir.c_str(), 0755) && EEXIST != errno) {
+                Err("Cannot create capture directory " + dir);
+                return nullptr;
+            }
+            Ptr w(new CaptureWriter(dir, segment_size, index_every));
+            w->index_fd = open(capture::index_path(dir).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            w->topics = fopen(capture::topics_path(dir).c_str(), "w");
+            if (-1 == w->index_fd || nullptr == w->topics) {
+                Err("Cannot create capture files in " + dir);
+                return nullptr;
+            }
+            w->next = std::async(std::launch::async, &CaptureWriter::prepare, dir, 0, segment_size);
+            if (!w->roll()) return nullptr;
+            return w;
+        }
+
+        ~CaptureWriter() {
+            if (next.valid()) {
+                Segment s = next.get();
+                if (nullptr != s.base) {
+                    munmap(s.base, segment_size);
+                    close(s.fd);
+                    unlink(capture::segment_path(dir, s.number).c_str());
+                }
+            }
+            finish();
+            if (-1 != index_fd) close(index_fd);
+            if (nullptr != topics) fclose(topics);
+        }
+
+        // Id of a recorded topic for append()
+        uint32_t add_topic(const std::string &name, ui msg_size) {
+            std::lock_guard<std::mutex> g(mutex);
+            auto id = (uint32_t) topic_count++;
+            fprintf(topics, "%u %lu %s\n", id, msg_size, name.c_str());
+            fflush(topics);
+            return id;
+        }
+
+        // `count` messages of `topic` lying `stride` bytes apart in `data`
+        bool append(uint32_t topic, const char *data, ui stride, const Topic::MsgInfo *infos, ui count) {
+            std::lock_guard<std::mutex> g(mutex);
+            for (ui i = 0; i < count; i++) {
+                ui need = capture::record_size(infos[i].size);
+                if (capture::HEADER_SIZE + need > segment_size) return Err("Message doesn't fit a capture segment");
+                if (offset + need > segment_size && !roll()) return false;
+                if (0 == records % index_every) add_index();
+                auto r = (capture::Record *) (cur.base + offset);
+                r->topic = topic;
+                r->size = (uint32_t) infos[i].size;
+                r->seq = infos[i].seq;
+                r->time_ns = infos[i].time_ns;
+                memcpy(r + 1, data + i * stride, infos[i].size);
+                offset += need;
+                records++;
+                if (0 == hdr()->first_ns) hdr()->first_ns = infos[i].time_ns;
+                hdr()->last_ns = infos[i].time_ns;
+                if (infos[i].time_ns > max_ns) max_ns = infos[i].time_ns;
+            }
+            publish();
+            return true;
+        }
+
+        ui get_records() {
+            std::lock_guard<std::mutex> g(mutex);
+            return records;
+        }
+
+        ui get_bytes() {
+            std::lock_guard<std::mutex> g(mutex);
+            return written + offset - capture::HEADER_SIZE;
+        }
+
+    private:
+        struct Segment {
+            ui number;
+            int fd;
+            char *base;
+        };
+
+        CaptureWriter(const std::string &dir, ui segment_size, ui index_every) {
+            this->dir = dir;
+            this->segment_size = segment_size;
+            this->index_every = index_every;
+        }
+
+        // Runs in the background: a zeroed segment file of full size, mapped and stamped
+        static Segment prepare(std::string dir, ui number, ui size) {
+            Segment s = {number, -1, nullptr};
+            std::string path = capture::segment_path(dir, number);
+            s.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (-1 == s.fd) return s;
+            if (0 != posix_fallocate(s.fd, 0, (off_t) size) && -1 == ftruncate(s.fd, (off_t) size)) {
+                close(s.fd);
+                return s;
+            }
+            void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, s.fd, 0);
+            if (MAP_FAILED == p) {
+                close(s.fd);
+                return s;
+            }
+            madvise(p, size, MADV_SEQUENTIAL);
+            s.base = (char *) p;
+            auto h = (capture::SegmentHeader *) s.base;
+            h->magic = capture::MAGIC;
+            h->segment = number;
+            return s;
+        }
+
+        capture::SegmentHeader *hdr() {
+            return (capture::SegmentHeader *) cur.base;
+        }
+
+        // Makes the records appended so far visible to readers of the segment
+        void publish() {
+            hdr()->records.store(records - seg_first, std::memory_order_relaxed);
+            hdr()->used.store(offset - capture::HEADER_SIZE, std::memory_order_release);
+        }
+
+        // Switches to the prepared segment and starts preparing the one after it
+        bool roll() {
+            finish();
+            cur = next.get();
+            if (nullptr == cur.base) return Err("Cannot create capture segment in " + dir);
+            next = std::async(std::launch::async, &CaptureWriter::prepare, dir, cur.number + 1, segment_size);
+            offset = capture::HEADER_SIZE;
+            seg_first = records;
+            add_index();
+            return true;
+        }
+
+        // Cuts the current segment to its used size
+        void finish() {
+            if (nullptr == cur.base) return;
+            publish();
+            hdr()->finished.store(1, std::memory_order_release);
+            written += offset - capture::HEADER_SIZE;
+            munmap(cur.base, segment_size);
+            if (-1 == ftruncate(cur.fd, (off_t) offset)) Err("Cannot truncate capture segment");
+            close(cur.fd);
+            cur.base = nullptr;
+        }
+
+        void add_index() {
+            if (indexed == records) return;
+            indexed = records;
+            capture::IndexEntry e = {max_ns + 1, records, cur.number, offset};
+            if (sizeof(e) != (size_t) write(index_fd, &e, sizeof(e))) Err("Cannot write capture index");
+        }
+
+        std::string dir;
+        ui segment_size, index_every;
+        int index_fd = -1;
+        FILE *topics = nullptr;
+        ui topic_count = 0;
+        Segment cur = {0, -1, nullptr};
+        std::future<Segment> next;
+        ui offset = 0, records = 0, seg_first = 0, written = 0;
+        ui indexed = ~(ui) 0;
+        int64_t max_ns = INT64_MIN;
+        std::mutex mutex;
+    };
+
+    // Reads a capture log, also while it is being recorded: records become visible as the writer
+    // publishes them. Record data stays mapped until the reader moves past the segment after it.
+    class CaptureReader {
+    public:
+        using Ptr = std::shared_ptr<CaptureReader>;
+
+        struct TopicInfo {
+            std::string name;
+            ui msg_size;
+        };
+
+        static Ptr just_open(const std::string &dir) {
+            Ptr r(new CaptureReader(dir));
+            if (!r->load() || !r->map(0)) return nullptr;
+            return r;
+        }
+
+        ~CaptureReader() {
+            unmap();
+        }
+
+        // Indexed by Record::topic
+        const std::vector<TopicInfo> &get_topics() {
+            return topics;
+        }
+
+        // Goes to the first record published at or after `time_ns`; later records from before it are skipped too
+        bool seek_time(int64_t time_ns) {
+            auto it = std::upper_bound(index.begin() + 1, index.end(), time_ns,
+                                       [](int64_t t, const capture::IndexEntry &e) { return t < e.time_ns; });
+            if (!go(*(it - 1))) return false;
+            min_time = time_ns;
+            return true;
+        }
+
+        // Goes to the `record`-th record of the log
+        bool seek_record(ui record) {
+            auto it = std::upper_bound(index.begin() + 1, index.end(), record,
+                                       [](ui r, const capture::IndexEntry &e) { return r < e.record; });
+            if (!go(*(it - 1))) return false;
+            capture::Record rec;
+            const char *data;
+            while (pos < record)
+                if (!next(rec, data)) return false;
+            return true;
+        }
+
+        // The next record, false at the end of what is recorded so far. `data` points into the segment
+        bool next(capture::Record &rec, const char *&data) {
+            while (true) {
+                if (offset >= capture::HEADER_SIZE + used()) {
+                    auto h = (capture::SegmentHeader *) base;
+                    if (!h->finished.load(std::memory_order_acquire)) return false;
+                    if (offset < capture::HEADER_SIZE + used()) continue;
+                    if (!map(segment + 1)) return false;
+                    continue;
+                }
+                auto r = (const capture::Record *) (base + offset);
+                rec = *r;
+                data = (const char *) (r + 1);
+                offset += capture::record_size(r->size);
+                pos++;
+                if (r->time_ns >= min_time) return true;
+            }
+        }
+
+        // Number of the record next() returns next (before skipping by time)
+        ui get_position() {
+            return pos;
+        }
+
+        // Segment of the record next() returned last
+        ui get_segment() {
+            return segment;
+        }
+
+    private:
+        explicit CaptureReader(const std::string &dir) {
+            this->dir = dir;
+        }
+
+        bool load() {
+            FILE *f = fopen(capture::topics_path(dir).c_str(), "r");
+            if (nullptr == f) return Err("Cannot open capture topics of " + dir);
+            unsigned id;
+            ui size;
+            char name[256];
+            while (3 == fscanf(f, "%u %lu %255s", &id, &size, name)) {
+                if (id >= topics.size()) topics.resize(id + 1);
+                topics[id] = TopicInfo{name, size};
+            }
+            fclose(f);
+            int fd = ::open(capture::index_path(dir).c_str(), O_RDONLY | O_CLOEXEC);
+            if (-1 == fd) return Err("Cannot open capture index of " + dir);
+            capture::IndexEntry e;
+            while (sizeof(e) == (size_t) read(fd, &e, sizeof(e))) index.push_back(e);
+            close(fd);
+            if (index.empty()) index.push_back(capture::IndexEntry{INT64_MIN, 0, 0, capture::HEADER_SIZE});
+            return true;
+        }
+
+        ui used() {
+            return ((capture::SegmentHeader *) base)->used.load(std::memory_order_acquire);
+        }
+
+        bool map(ui number) {
+            int fd = ::open(capture::segment_path(dir, number).c_str(), O_RDONLY | O_CLOEXEC);
+            if (-1 == fd) return false;
+            struct stat st;
+            void *p = MAP_FAILED;
+            if (0 == fstat(fd, &st) && (ui) st.st_size >= capture::HEADER_SIZE)
+                p = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (MAP_FAILED == p) return false;
+            if (capture::MAGIC != ((capture::SegmentHeader *) p)->magic) {
+                munmap(p, (size_t) st.st_size);
+                return Err("Bad capture segment " + capture::segment_path(dir, number));
+            }
+            if (nullptr != prev) munmap(prev, prev_mapped);
+            prev = base;
+            prev_mapped = mapped;
+            base = (char *) p;
+            mapped = (ui) st.st_size;
+            segment = number;
+            offset = capture::HEADER_SIZE;
+            return true;
+        }
+
+        void unmap() {
+            if (nullptr != prev) munmap(prev, prev_mapped);
+            if (nullptr != base) munmap(base, mapped);
+            prev = base = nullptr;
+        }
+
+        bool go(const capture::IndexEntry &e) {
+            if (e.segment != segment && !map(e.segment)) return false;
+            offset = e.offset;
+            pos = e.record;
+            min_time = INT64_MIN;
+            return true;
+        }
+
+        std::string dir;
+        std::vector<TopicInfo> topics;
+        std::vector<capture::IndexEntry> index;
+        char *base = nullptr, *prev = nullptr;
+        ui mapped = 0, prev_mapped = 0, segment = 0, offset = 0, pos = 0;
+        int64_t min_time = INT64_MIN;
+    };
+}
+
+#endif //PUBSUBCPP_CAPTURE_HPP
@@ -0,0 +1,151 @@
+"""asyncio front end of the clap module.
+
+A Hub runs one clap.Watcher thread per event loop. The watcher polls every topic, box and
+office that a coroutine waits for and signals an eventfd registered with loop.add_reader(),
+so any number of topics are served by the loop thread without a blocking thread per topic.
+Coroutines first try the non-blocking call and only wait for readiness when it finds nothing.
+
+    hub = clap_asyncio.Hub()
+    topic = hub.topic(clap.Topic('/prices'))
+    async for msg in topic:
+        ...
+    office = hub.office(clap.Office('/pricer', 64, 64))
+    answer = await office.request(b'question')
+"""
+import asyncio
+
+import clap
+
+
+class Hub:
+    """Readiness of clap objects for one event loop."""
+
+    def __init__(self, loop=None, max_sleep=0.001):
+        self.loop = loop or asyncio.get_running_loop()
+        self.watcher = clap.Watcher(max_sleep)
+        self.waiting = {}
+        self.loop.add_reader(self.watcher.fileno(), self._on_ready)
+
+    def topic(self, topic):
+        return AsyncTopic(self, topic)
+
+    def box(self, box):
+        return AsyncBox(self, box)
+
+    def office(self, office):
+        return AsyncOffice(self, office)
+
+    def close(self):
+        self.loop.remove_reader(self.watcher.fileno())
+        for futs in self.waiting.values():
+            for fut in futs:
+                if not fut.done():
+                    fut.cancel()
+        self.waiting.clear()
+
+    async def until(self, source_id, attempt):
+        """Repeats attempt() until it returns something other than None, waiting for
+        `source_id` to become ready in between. Any number of coroutines may wait for
+        one source; readiness wakes them all and each one attempts again."""
+        while True:
+            res = attempt()
+            if res is not None:
+                return res
+            fut = self.loop.create_future()
+            self.waiting.setdefault(source_id, []).append(fut)
+            self.watcher.arm(source_id)
+            try:
+                await fut
+            finally:
+                futs = self.waiting.get(source_id)
+                if futs is not None and fut in futs:
+                    futs.remove(fut)
+                    if not futs:
+                        del self.waiting[source_id]
+
+    def _on_ready(self):
+        for source_id in self.watcher.take():
+            for fut in self.waiting.pop(source_id, ()):
+                if not fut.done():
+                    fut.set_result(None)
+
+
+class AsyncTopic:
+    """Subscriber side of a clap.Topic; one consumer coroutine at a time."""
+
+    def __init__(self, hub, topic):
+        self.hub = hub
+        self.topic = topic
+        self.id = hub.watcher.add(topic)
+
+    async def recv(self):
+        return await self.hub.until(self.id, lambda: self.topic.sub(0))
+
+    async def recv_batch(self, max_count):
+        """All published messages up to `max_count` as clap.Topic.sub_batch() returns them."""
+        def attempt():
+            data, sizes = self.topic.sub_batch(max_count, 0)
+            return (data, sizes) if len(sizes) else None
+        return await self.hub.until(self.id, attempt)
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        return await self.recv()
+
+    def close(self):
+        self.hub.watcher.remove(self.id)
+
+
+class AsyncBox:
+    """Either side of a clap.Box."""
+
+    def __init__(self, hub, box):
+        self.hub = hub
+        self.box = box
+        self.get_id = hub.watcher.add(box)
+        self.put_id = hub.watcher.add(box, writable=True)
+
+    async def put(self, data):
+        await self.hub.until(self.put_id, lambda: self.box.try_put(data) or None)
+
+    async def get(self):
+        self.box.offer()
+        try:
+            return await self.hub.until(self.get_id, self.box.try_get)
+        except BaseException:
+            self.box.withdraw()
+            raise
+
+    def close(self):
+        self.hub.watcher.remove(self.get_id)
+        self.hub.watcher.remove(self.put_id)
+
+
+class AsyncOffice:
+    """clap.Office for clients (request) and servers (question, answer).
+
+    An office pairs answers with questions by order, so the requests of one AsyncOffice
+    take turns: any number of coroutines may call request() concurrently."""
+
+    def __init__(self, hub, office):
+        self.office = office
+        self.questions = AsyncBox(hub, office.questions)
+        self.answers = AsyncBox(hub, office.answers)
+        self.turn = asyncio.Lock()
+
+    async def request(self, question):
+        async with self.turn:
+            await self.questions.put(question)
+            return await self.answers.get()
+
+    async def question(self):
+        return await self.questions.get()
+
+    async def answer(self, data):
+        await self.answers.put(data)
+
+    def close(self):
+        self.questions.close()
+        self.answers.close()
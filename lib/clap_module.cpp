@@ -0,0 +1,1057 @@
+// CPython extension module `clap`: Topic, Variable, Box and Office as Python types.
+//
+// Unlike the ctypes API of topic.cpp, calls take and fill any object supporting the buffer
+// protocol (bytes, bytearray, memoryview, numpy arrays) directly, so a message is copied once,
+// between shared memory and the caller's buffer. Blocking calls release the GIL.
+
+#define PY_SSIZE_T_CLEAN
+#include "Python.h"
+#include <new>
+#include <string>
+#include "topic.hpp"
+
+namespace {
+    // Blocking calls return 0/false when a signal arrives; turn that into KeyboardInterrupt
+    PyObject *fail(PyObject *type, const std::string &msg) {
+        if (tpc::interrupted) PyErr_SetNone(PyExc_KeyboardInterrupt);
+        else PyErr_SetString(type, msg.c_str());
+        return nullptr;
+    }
+
+    bool fits(Py_buffer &buf, ui size) {
+        if ((ui) buf.len >= size) return true;
+        PyErr_Format(PyExc_ValueError, "buffer of %zd bytes is smaller than message size %lu", buf.len, size);
+        PyBuffer_Release(&buf);
+        return false;
+    }
+
+    template<typename Obj>
+    PyObject *generic_new(PyTypeObject *type, PyObject *, PyObject *) {
+        auto self = (Obj *) type->tp_alloc(type, 0);
+        if (nullptr != self) new(&self->ptr) decltype(Obj::ptr)();
+        return (PyObject *) self;
+    }
+
+    template<typename Obj>
+    void generic_dealloc(PyObject *obj) {
+        using Ptr = decltype(Obj::ptr);
+        ((Obj *) obj)->ptr.~Ptr();
+        Py_TYPE(obj)->tp_free(obj);
+    }
+
+    // ---- Topic ----
+
+    struct TopicObject {
+        PyObject_HEAD
+        Topic::Ptr ptr;
+    };
+
+    int topic_init(TopicObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"name", "msg_size", "msg_count", "create", nullptr};
+        const char *name;
+        unsigned long size = 0, count = 0;
+        int create = 0;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|kkp", (char **) kwlist, &name, &size, &count, &create))
+            return -1;
+        std::string n(name);
+        if (create) self->ptr = Topic::spawn_create(n, size, count);
+        else if (0 == size) self->ptr = Topic::spawn(n);
+        else if (0 == count) self->ptr = Topic::spawn(n, size);
+        else self->ptr = Topic::spawn(n, size, count);
+        if (nullptr != self->ptr) return 0;
+        PyErr_Format(PyExc_OSError, "cannot open topic %s", name);
+        return -1;
+    }
+
+    PyObject *topic_pub(TopicObject *self, PyObject *args) {
+        Py_buffer buf;
+        if (!PyArg_ParseTuple(args, "y*", &buf)) return nullptr;
+        if ((ui) buf.len > self->ptr->get_msg_size()) {
+            PyBuffer_Release(&buf);
+            return fail(PyExc_ValueError, "message is bigger than topic message size");
+        }
+        ui res;
+        Py_BEGIN_ALLOW_THREADS
+        res = self->ptr->pub(buf.buf, (ui) buf.len);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (0 == res && 0 != buf.len) return fail(PyExc_OSError, "pub failed");
+        return PyLong_FromUnsignedLong(res);
+    }
+
+    // Timeouts come from Python as seconds, negative - wait forever
+    long to_us(double timeout) {
+        return timeout < 0 ? -1 : (long) (timeout * 1e6);
+    }
+
+    PyObject *topic_sub(TopicObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"timeout", nullptr};
+        double timeout = -1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "|d", (char **) kwlist, &timeout)) return nullptr;
+        ui size = self->ptr->get_msg_size();
+        PyObject *res = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) size);
+        if (nullptr == res) return nullptr;
+        char *dst = PyBytes_AS_STRING(res);
+        long us = to_us(timeout);
+        ui got;
+        Py_BEGIN_ALLOW_THREADS
+        got = self->ptr->sub(dst, us);
+        Py_END_ALLOW_THREADS
+        if (0 == got) {
+            Py_DECREF(res);
+            if (us >= 0 && !tpc::interrupted) Py_RETURN_NONE;
+            return fail(PyExc_OSError, "sub failed");
+        }
+        if (got != size && 0 != _PyBytes_Resize(&res, (Py_ssize_t) got)) return nullptr;
+        return res;
+    }
+
+    PyObject *topic_sub_into(TopicObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"buffer", "timeout", nullptr};
+        Py_buffer buf;
+        double timeout = -1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "w*|d", (char **) kwlist, &buf, &timeout)) return nullptr;
+        if (!fits(buf, self->ptr->get_msg_size())) return nullptr;
+        long us = to_us(timeout);
+        ui got;
+        Py_BEGIN_ALLOW_THREADS
+        got = self->ptr->sub(buf.buf, us);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (0 == got && (us < 0 || tpc::interrupted)) return fail(PyExc_OSError, "sub failed");
+        return PyLong_FromUnsignedLong(got);
+    }
+
+    // Messages of a batch lie in one buffer `msg_size` bytes apart; their sizes are native
+    // unsigned longs, e.g. numpy.frombuffer(sizes, numpy.uint64)
+    PyObject *topic_sub_batch(TopicObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"max", "timeout", nullptr};
+        unsigned long max;
+        double timeout = -1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "k|d", (char **) kwlist, &max, &timeout)) return nullptr;
+        ui size = self->ptr->get_msg_size();
+        PyObject *data = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) (size * max));
+        PyObject *sizes = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) (sizeof(ui) * max));
+        if (nullptr == data || nullptr == sizes) {
+            Py_XDECREF(data);
+            Py_XDECREF(sizes);
+            return nullptr;
+        }
+        char *dst = PyBytes_AS_STRING(data);
+        auto szs = (ui *) PyBytes_AS_STRING(sizes);
+        long us = to_us(timeout);
+        ui n;
+        Py_BEGIN_ALLOW_THREADS
+        n = self->ptr->sub_batch(dst, max, szs, us);
+        Py_END_ALLOW_THREADS
+        if (0 == n && tpc::interrupted) {
+            Py_DECREF(data);
+            Py_DECREF(sizes);
+            return fail(PyExc_OSError, "sub failed");
+        }
+        if ((n != max && 0 != _PyBytes_Resize(&data, (Py_ssize_t) (size * n)))
+            || (n != max && 0 != _PyBytes_Resize(&sizes, (Py_ssize_t) (sizeof(ui) * n)))) {
+            Py_XDECREF(data);
+            Py_XDECREF(sizes);
+            return nullptr;
+        }
+        return Py_BuildValue("(NN)", data, sizes);
+    }
+
+    PyObject *topic_sub_batch_into(TopicObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"buffer", "sizes", "timeout", nullptr};
+        Py_buffer buf, sizes = {};
+        PyObject *sizes_obj = Py_None;
+        double timeout = -1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "w*|Od", (char **) kwlist, &buf, &sizes_obj, &timeout))
+            return nullptr;
+        ui size = self->ptr->get_msg_size();
+        if (!fits(buf, size)) return nullptr;
+        ui max = (ui) buf.len / size;
+        if (Py_None != sizes_obj) {
+            if (0 != PyObject_GetBuffer(sizes_obj, &sizes, PyBUF_WRITABLE)) {
+                PyBuffer_Release(&buf);
+                return nullptr;
+            }
+            if ((ui) sizes.len / sizeof(ui) < max) max = (ui) sizes.len / sizeof(ui);
+        }
+        long us = to_us(timeout);
+        ui n;
+        Py_BEGIN_ALLOW_THREADS
+        n = self->ptr->sub_batch(buf.buf, max, Py_None == sizes_obj ? nullptr : (ui *) sizes.buf, us);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (Py_None != sizes_obj) PyBuffer_Release(&sizes);
+        if (0 == n && tpc::interrupted) return fail(PyExc_OSError, "sub failed");
+        return PyLong_FromUnsignedLong(n);
+    }
+
+    PyObject *topic_remove(PyObject *, PyObject *args) {
+        const char *name;
+        if (!PyArg_ParseTuple(args, "s", &name)) return nullptr;
+        return PyBool_FromLong(Topic::remove(std::string(name)));
+    }
+
+    PyObject *topic_msg_size(TopicObject *self, void *) {
+        return PyLong_FromUnsignedLong(self->ptr->get_msg_size());
+    }
+
+    PyObject *topic_msg_count(TopicObject *self, void *) {
+        return PyLong_FromUnsignedLong(self->ptr->get_msg_count());
+    }
+
+    PyObject *topic_name(TopicObject *self, void *) {
+        return PyUnicode_FromString(self->ptr->get_name().c_str());
+    }
+
+    PyMethodDef topic_methods[] = {
+        {"pub", (PyCFunction) topic_pub, METH_VARARGS,
+         "pub(data) -> int\nPublishes bytes-like `data`, returns its size."},
+        {"sub", (PyCFunction) topic_sub, METH_VARARGS | METH_KEYWORDS,
+         "sub(timeout=-1) -> bytes\nBlocks for the next message, returns None after `timeout` seconds if not negative."},
+        {"sub_into", (PyCFunction) topic_sub_into, METH_VARARGS | METH_KEYWORDS,
+         "sub_into(buffer, timeout=-1) -> int\nBlocks for the next message and copies it into writable `buffer`, "
+         "returns its size (0 on timeout)."},
+        {"sub_batch", (PyCFunction) topic_sub_batch, METH_VARARGS | METH_KEYWORDS,
+         "sub_batch(max, timeout=-1) -> (data, sizes)\nWaits up to `timeout` seconds for a message, then takes up to "
+         "`max` published ones with the GIL released once. Message i is data[i * msg_size:], `sizes` holds native "
+         "unsigned longs, e.g. numpy.frombuffer(sizes, numpy.uint64)."},
+        {"sub_batch_into", (PyCFunction) topic_sub_batch_into, METH_VARARGS | METH_KEYWORDS,
+         "sub_batch_into(buffer, sizes=None, timeout=-1) -> int\nSame as sub_batch, but fills writable `buffer` "
+         "(up to len(buffer) // msg_size messages) and `sizes`, returns the count of messages."},
+        {"remove", (PyCFunction) topic_remove, METH_VARARGS | METH_STATIC,
+         "remove(name) -> bool\nRemoves shared memory and semaphores of a topic."},
+        {nullptr}
+    };
+
+    PyGetSetDef topic_getset[] = {
+        {"msg_size", (getter) topic_msg_size, nullptr, nullptr, nullptr},
+        {"msg_count", (getter) topic_msg_count, nullptr, nullptr, nullptr},
+        {"name", (getter) topic_name, nullptr, nullptr, nullptr},
+        {nullptr}
+    };
+
+    PyTypeObject TopicType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    // ---- Variable ----
+
+    struct VariableObject {
+        PyObject_HEAD
+        Variable::Ptr ptr;
+        ui size;
+    };
+
+    int variable_init(VariableObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"name", "size", "mode", "create", nullptr};
+        const char *name;
+        unsigned long size;
+        unsigned int mode = Variable::rwlock;
+        int create = 1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "sk|Ip", (char **) kwlist, &name, &size, &mode, &create))
+            return -1;
+        if (!Variable::valid_mode(mode)) {
+            PyErr_Format(PyExc_ValueError, "unknown variable mode %u", mode);
+            return -1;
+        }
+        std::string n(name);
+        auto m = (Variable::Mode) mode;
+        self->ptr = create ? Variable::open_create(n, size, m) : Variable::just_open(n, size, m);
+        self->size = size;
+        if (nullptr != self->ptr) return 0;
+        PyErr_Format(PyExc_OSError, "cannot open variable %s", name);
+        return -1;
+    }
+
+    PyObject *variable_read(VariableObject *self, PyObject *) {
+        PyObject *res = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) self->size);
+        if (nullptr == res) return nullptr;
+        char *dst = PyBytes_AS_STRING(res);
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->read(dst);
+        Py_END_ALLOW_THREADS
+        if (ok) return res;
+        Py_DECREF(res);
+        return fail(PyExc_OSError, "read failed");
+    }
+
+    PyObject *variable_read_into(VariableObject *self, PyObject *args) {
+        Py_buffer buf;
+        if (!PyArg_ParseTuple(args, "w*", &buf)) return nullptr;
+        if (!fits(buf, self->size)) return nullptr;
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->read(buf.buf);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (!ok) return fail(PyExc_OSError, "read failed");
+        Py_RETURN_NONE;
+    }
+
+    PyObject *variable_write(VariableObject *self, PyObject *args) {
+        Py_buffer buf;
+        if (!PyArg_ParseTuple(args, "y*", &buf)) return nullptr;
+        if ((ui) buf.len > self->size) {
+            PyBuffer_Release(&buf);
+            return fail(PyExc_ValueError, "data is bigger than variable size");
+        }
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->write(buf.buf, (ui) buf.len);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (!ok) return fail(PyExc_OSError, "write failed");
+        Py_RETURN_NONE;
+    }
+
+    PyObject *variable_remove(PyObject *, PyObject *args) {
+        const char *name;
+        if (!PyArg_ParseTuple(args, "s", &name)) return nullptr;
+        return PyBool_FromLong(Variable::remove(std::string(name)));
+    }
+
+    PyObject *variable_size(VariableObject *self, void *) {
+        return PyLong_FromUnsignedLong(self->size);
+    }
+
+    PyObject *variable_version(VariableObject *self, void *) {
+        return PyLong_FromUnsignedLong(self->ptr->version());
+    }
+
+    PyObject *variable_set_layout(VariableObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"format", "shape", nullptr};
+        const char *format;
+        PyObject *shape_obj;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "sO", (char **) kwlist, &format, &shape_obj)) return nullptr;
+        Py_ssize_t itemsize = PyBuffer_SizeFromFormat(format);
+        if (itemsize <= 0) return nullptr;
+        ui shape[Variable::MAX_DIMS], ndim = 0;
+        if (PyLong_Check(shape_obj)) {
+            shape[ndim++] = PyLong_AsUnsignedLong(shape_obj);
+        } else {
+            PyObject *seq = PySequence_Fast(shape_obj, "shape should be an int or a sequence of ints");
+            if (nullptr == seq) return nullptr;
+            Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+            for (Py_ssize_t i = 0; i < n && ndim < Variable::MAX_DIMS; i++)
+                shape[ndim++] = PyLong_AsUnsignedLong(PySequence_Fast_GET_ITEM(seq, i));
+            Py_DECREF(seq);
+            if (n > (Py_ssize_t) Variable::MAX_DIMS) return fail(PyExc_ValueError, "too many dimensions");
+        }
+        if (PyErr_Occurred()) return nullptr;
+        if (!self->ptr->set_layout(format, (ui) itemsize, shape, ndim))
+            return fail(PyExc_ValueError, "layout doesn't fit the variable");
+        Py_RETURN_NONE;
+    }
+
+    PyObject *variable_layout(VariableObject *self, void *) {
+        Variable::Layout l;
+        if (!self->ptr->get_layout(l)) Py_RETURN_NONE;
+        PyObject *shape = PyTuple_New((Py_ssize_t) l.ndim);
+        if (nullptr == shape) return nullptr;
+        for (ui i = 0; i < l.ndim; i++) PyTuple_SET_ITEM(shape, i, PyLong_FromUnsignedLong(l.shape[i]));
+        return Py_BuildValue("(sN)", l.format, shape);
+    }
+
+    PyTypeObject VariableType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    // ---- Variable sections ----
+
+    PyObject *TornRead;
+
+    // The layout is fixed when the section is made, so buffers exported earlier keep their format.
+    // Leaving waits for the last export: shared memory is never mapped into Python without the section.
+    struct SectionState {
+        Variable::Ptr var;
+        Variable::Section section;
+        bool write;
+        bool entered = false;
+        bool leaving = false;       // __exit__ found live exports, the last one released leaves
+        PyObject *view = nullptr;   // the memoryview __enter__ returned
+        Py_ssize_t exports = 0;
+        std::string format;
+        Py_ssize_t itemsize, len, ndim;
+        Py_ssize_t shape[Variable::MAX_DIMS], strides[Variable::MAX_DIMS];
+    };
+
+    struct SectionObject {
+        PyObject_HEAD
+        std::unique_ptr<SectionState> ptr;
+    };
+
+    PyTypeObject SectionType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    int section_init(SectionObject *, PyObject *, PyObject *) {
+        PyErr_SetString(PyExc_TypeError, "sections are made by Variable.reading() and Variable.writing()");
+        return -1;
+    }
+
+    PyObject *make_section(VariableObject *var, bool write) {
+        auto self = (SectionObject *) SectionType.tp_new(&SectionType, nullptr, nullptr);
+        if (nullptr == self) return nullptr;
+        auto st = new SectionState();
+        self->ptr.reset(st);
+        st->var = var->ptr;
+        st->write = write;
+        Variable::Layout l;
+        if (!var->ptr->get_layout(l)) {
+            l.format[0] = 'B';
+            l.format[1] = 0;
+            l.itemsize = 1;
+            l.ndim = 1;
+            l.shape[0] = var->size;
+        }
+        st->format = l.format;
+        st->itemsize = (Py_ssize_t) l.itemsize;
+        st->ndim = (Py_ssize_t) l.ndim;
+        st->len = st->itemsize;
+        for (Py_ssize_t i = st->ndim - 1; i >= 0; i--) {
+            st->shape[i] = (Py_ssize_t) l.shape[i];
+            st->strides[i] = st->len;
+            st->len *= st->shape[i];
+        }
+        return (PyObject *) self;
+    }
+
+    PyObject *variable_reading(VariableObject *self, PyObject *) {
+        return make_section(self, false);
+    }
+
+    PyObject *variable_writing(VariableObject *self, PyObject *) {
+        return make_section(self, true);
+    }
+
+    int section_getbuffer(SectionObject *self, Py_buffer *view, int flags) {
+        view->obj = nullptr;
+        auto st = self->ptr.get();
+        if (nullptr == st || nullptr == st->section.data) {
+            PyErr_SetString(PyExc_BufferError, "section isn't entered");
+            return -1;
+        }
+        if ((flags & PyBUF_WRITABLE) && !st->section.writable) {
+            PyErr_SetString(PyExc_BufferError, "read section is read-only");
+            return -1;
+        }
+        view->buf = st->section.data;
+        view->len = st->len;
+        view->readonly = !st->section.writable;
+        view->itemsize = st->itemsize;
+        view->format = (flags & PyBUF_FORMAT) ? (char *) st->format.c_str() : nullptr;
+        view->ndim = (int) st->ndim;
+        view->shape = (flags & PyBUF_ND) ? st->shape : nullptr;
+        view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? st->strides : nullptr;
+        view->suboffsets = nullptr;
+        view->internal = nullptr;
+        Py_INCREF(self);
+        view->obj = (PyObject *) self;
+        st->exports++;
+        return 0;
+    }
+
+    void section_releasebuffer(SectionObject *self, Py_buffer *) {
+        auto st = self->ptr.get();
+        if (nullptr == st || 0 != --st->exports || !st->leaving) return;
+        st->var->leave(st->section);
+        st->leaving = false;
+        st->entered = false;
+    }
+
+    PyBufferProcs section_buffer = {(getbufferproc) section_getbuffer, (releasebufferproc) section_releasebuffer};
+
+    // Returns a memoryview of the value in shared memory, numpy.asarray() of it doesn't copy
+    PyObject *section_enter(SectionObject *self, PyObject *) {
+        auto st = self->ptr.get();
+        if (nullptr == st || st->entered) return fail(PyExc_RuntimeError, "section is already entered");
+        st->entered = true;
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = st->write ? st->var->enter_write(st->section) : st->var->enter_read(st->section);
+        Py_END_ALLOW_THREADS
+        if (!ok) {
+            st->entered = false;
+            return fail(PyExc_OSError, "cannot enter section");
+        }
+        PyObject *view = PyMemoryView_FromObject((PyObject *) self);
+        if (nullptr == view) {
+            st->var->leave(st->section);
+            st->entered = false;
+            return nullptr;
+        }
+        Py_INCREF(view);
+        st->view = view;
+        return view;
+    }
+
+    PyObject *section_exit(SectionObject *self, PyObject *args) {
+        PyObject *type = Py_None, *value = Py_None, *tb = Py_None;
+        if (!PyArg_ParseTuple(args, "|OOO", &type, &value, &tb)) return nullptr;
+        auto st = self->ptr.get();
+        if (nullptr == st || !st->entered || st->leaving) return fail(PyExc_RuntimeError, "section isn't entered");
+        // A released view raises on use; it can't be released while something holds a buffer of it
+        PyObject *released = PyObject_CallMethod(st->view, "release", nullptr);
+        if (nullptr == released) PyErr_Clear();
+        Py_XDECREF(released);
+        Py_CLEAR(st->view);
+        if (st->exports > 0) {
+            st->leaving = true;
+            return fail(PyExc_BufferError, "buffers of the section outlive the block, it is left when they are released");
+        }
+        bool consistent;
+        Py_BEGIN_ALLOW_THREADS
+        consistent = st->var->leave(st->section);
+        Py_END_ALLOW_THREADS
+        st->entered = false;
+        if (!consistent && Py_None == type) {
+            PyErr_SetString(TornRead, "a writer changed the value during the read section");
+            return nullptr;
+        }
+        Py_RETURN_FALSE;
+    }
+
+    PyMethodDef section_methods[] = {
+        {"__enter__", (PyCFunction) section_enter, METH_NOARGS, nullptr},
+        {"__exit__", (PyCFunction) section_exit, METH_VARARGS, nullptr},
+        {nullptr}
+    };
+
+    PyMethodDef variable_methods[] = {
+        {"read", (PyCFunction) variable_read, METH_NOARGS,
+         "read() -> bytes"},
+        {"read_into", (PyCFunction) variable_read_into, METH_VARARGS,
+         "read_into(buffer)\nCopies the value into writable `buffer` of at least `size` bytes."},
+        {"write", (PyCFunction) variable_write, METH_VARARGS,
+         "write(data)\nWrites bytes-like `data` (up to `size` bytes) at the start of the value."},
+        {"set_layout", (PyCFunction) variable_set_layout, METH_VARARGS | METH_KEYWORDS,
+         "set_layout(format, shape)\nStores the item format (struct module syntax, e.g. 'd') and the shape "
+         "of the value for sections made afterwards by any process."},
+        {"reading", (PyCFunction) variable_reading, METH_NOARGS,
+         "reading() -> section\n`with var.reading() as m:` gives a read-only memoryview of the value in shared "
+         "memory shaped by the layout. Lock modes hold the read lock inside the block, in seqlock mode leaving "
+         "the block raises TornRead if a writer interfered."},
+        {"writing", (PyCFunction) variable_writing, METH_NOARGS,
+         "writing() -> section\n`with var.writing() as m:` gives a writable memoryview of the value holding "
+         "the write lock; the new value is published when the block ends."},
+        {"remove", (PyCFunction) variable_remove, METH_VARARGS | METH_STATIC,
+         "remove(name) -> bool"},
+        {nullptr}
+    };
+
+    PyGetSetDef variable_getset[] = {
+        {"size", (getter) variable_size, nullptr, nullptr, nullptr},
+        {"version", (getter) variable_version, nullptr, nullptr, nullptr},
+        {"layout", (getter) variable_layout, nullptr, nullptr, nullptr},
+        {nullptr}
+    };
+
+
+    // ---- Box ----
+
+    struct BoxObject {
+        PyObject_HEAD
+        Box::Ptr ptr;
+        ui size;
+    };
+
+    int box_init(BoxObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"name", "size", "create", nullptr};
+        const char *name;
+        unsigned long size;
+        int create = 1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "sk|p", (char **) kwlist, &name, &size, &create))
+            return -1;
+        std::string n(name);
+        self->ptr = create ? Box::open_create(n, size) : Box::just_open(n, size);
+        self->size = size;
+        if (nullptr != self->ptr) return 0;
+        PyErr_Format(PyExc_OSError, "cannot open box %s", name);
+        return -1;
+    }
+
+    PyObject *box_put(BoxObject *self, PyObject *args) {
+        Py_buffer buf;
+        if (!PyArg_ParseTuple(args, "y*", &buf)) return nullptr;
+        if ((ui) buf.len > self->size) {
+            PyBuffer_Release(&buf);
+            return fail(PyExc_ValueError, "data is bigger than box size");
+        }
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->put(buf.buf, (ui) buf.len);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (!ok) return fail(PyExc_OSError, "put failed");
+        Py_RETURN_NONE;
+    }
+
+    PyObject *box_get(BoxObject *self, PyObject *) {
+        PyObject *res = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) self->size);
+        if (nullptr == res) return nullptr;
+        char *dst = PyBytes_AS_STRING(res);
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->get(dst);
+        Py_END_ALLOW_THREADS
+        if (ok) return res;
+        Py_DECREF(res);
+        return fail(PyExc_OSError, "get failed");
+    }
+
+    PyObject *box_get_into(BoxObject *self, PyObject *args) {
+        Py_buffer buf;
+        if (!PyArg_ParseTuple(args, "w*", &buf)) return nullptr;
+        if (!fits(buf, self->size)) return nullptr;
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->get(buf.buf, self->size);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (!ok) return fail(PyExc_OSError, "get failed");
+        Py_RETURN_NONE;
+    }
+
+    PyObject *box_try_put(BoxObject *self, PyObject *args) {
+        Py_buffer buf;
+        if (!PyArg_ParseTuple(args, "y*", &buf)) return nullptr;
+        if ((ui) buf.len > self->size) {
+            PyBuffer_Release(&buf);
+            return fail(PyExc_ValueError, "data is bigger than box size");
+        }
+        bool ok = self->ptr->try_put(buf.buf, (ui) buf.len);
+        PyBuffer_Release(&buf);
+        return PyBool_FromLong(ok);
+    }
+
+    PyObject *box_offer(BoxObject *self, PyObject *) {
+        self->ptr->offer();
+        Py_RETURN_NONE;
+    }
+
+    PyObject *box_try_get(BoxObject *self, PyObject *) {
+        PyObject *res = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) self->size);
+        if (nullptr == res) return nullptr;
+        if (self->ptr->try_get(PyBytes_AS_STRING(res), self->size)) return res;
+        Py_DECREF(res);
+        Py_RETURN_NONE;
+    }
+
+    PyObject *box_withdraw(BoxObject *self, PyObject *) {
+        Py_BEGIN_ALLOW_THREADS
+        self->ptr->withdraw();
+        Py_END_ALLOW_THREADS
+        Py_RETURN_NONE;
+    }
+
+    PyObject *box_remove(PyObject *, PyObject *args) {
+        const char *name;
+        if (!PyArg_ParseTuple(args, "s", &name)) return nullptr;
+        return PyBool_FromLong(Box::remove(std::string(name)));
+    }
+
+    PyObject *box_size(BoxObject *self, void *) {
+        return PyLong_FromUnsignedLong(self->size);
+    }
+
+    PyMethodDef box_methods[] = {
+        {"put", (PyCFunction) box_put, METH_VARARGS,
+         "put(data)\nBlocks until a reader takes bytes-like `data`."},
+        {"get", (PyCFunction) box_get, METH_NOARGS,
+         "get() -> bytes"},
+        {"get_into", (PyCFunction) box_get_into, METH_VARARGS,
+         "get_into(buffer)\nBlocks for a value and copies it into writable `buffer`."},
+        {"try_put", (PyCFunction) box_try_put, METH_VARARGS,
+         "try_put(data) -> bool\nHands `data` to a reader that is already waiting, never blocks."},
+        {"offer", (PyCFunction) box_offer, METH_NOARGS,
+         "offer()\nLets one put() through without waiting in get(); take the value with try_get()."},
+        {"try_get", (PyCFunction) box_try_get, METH_NOARGS,
+         "try_get() -> bytes\nThe value put after offer(), None if there is none yet."},
+        {"withdraw", (PyCFunction) box_withdraw, METH_NOARGS,
+         "withdraw()\nTakes back an offer(); a value already being put is dropped."},
+        {"remove", (PyCFunction) box_remove, METH_VARARGS | METH_STATIC,
+         "remove(name) -> bool"},
+        {nullptr}
+    };
+
+    PyGetSetDef box_getset[] = {
+        {"size", (getter) box_size, nullptr, nullptr, nullptr},
+        {nullptr}
+    };
+
+    PyTypeObject BoxType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    PyObject *wrap_box(Box::Ptr box) {
+        auto self = (BoxObject *) BoxType.tp_new(&BoxType, nullptr, nullptr);
+        if (nullptr == self) return nullptr;
+        self->ptr = box;
+        self->size = box->get_size();
+        return (PyObject *) self;
+    }
+
+    // ---- Office ----
+
+    struct OfficeObject {
+        PyObject_HEAD
+        Office::Ptr ptr;
+        ui in_size, out_size;
+    };
+
+    int office_init(OfficeObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"name", "in_size", "out_size", "create", nullptr};
+        const char *name;
+        unsigned long in_size, out_size;
+        int create = 0;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "skk|p", (char **) kwlist, &name, &in_size, &out_size, &create))
+            return -1;
+        std::string n(name);
+        self->ptr = create ? Office::open_create(n, in_size, out_size) : Office::just_open(n, in_size, out_size);
+        self->in_size = in_size;
+        self->out_size = out_size;
+        if (nullptr != self->ptr) return 0;
+        PyErr_Format(PyExc_OSError, "cannot open office %s", name);
+        return -1;
+    }
+
+    PyObject *office_ask(OfficeObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"question", "timeout", nullptr};
+        Py_buffer buf;
+        double timeout = -1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|d", (char **) kwlist, &buf, &timeout)) return nullptr;
+        if ((ui) buf.len > self->in_size) {
+            PyBuffer_Release(&buf);
+            return fail(PyExc_ValueError, "question is bigger than office input size");
+        }
+        long us = to_us(timeout);
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = us < 0 ? self->ptr->ask(buf.buf, (ui) buf.len) : self->ptr->ask(buf.buf, (ui) buf.len, us);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (!ok && (us < 0 || tpc::interrupted)) return fail(PyExc_OSError, "ask failed");
+        return PyBool_FromLong(ok);
+    }
+
+    PyObject *office_wait(OfficeObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"timeout", nullptr};
+        double timeout = -1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "|d", (char **) kwlist, &timeout)) return nullptr;
+        PyObject *res = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) self->out_size);
+        if (nullptr == res) return nullptr;
+        char *dst = PyBytes_AS_STRING(res);
+        long us = to_us(timeout);
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = us < 0 ? self->ptr->wait(dst, self->out_size) : self->ptr->wait(dst, self->out_size, us);
+        Py_END_ALLOW_THREADS
+        if (ok) return res;
+        Py_DECREF(res);
+        if (us >= 0 && !tpc::interrupted) Py_RETURN_NONE;
+        return fail(PyExc_OSError, "wait failed");
+    }
+
+    PyObject *office_request(OfficeObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"question", "timeout", nullptr};
+        Py_buffer buf;
+        double timeout = -1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|d", (char **) kwlist, &buf, &timeout)) return nullptr;
+        if ((ui) buf.len > self->in_size) {
+            PyBuffer_Release(&buf);
+            return fail(PyExc_ValueError, "question is bigger than office input size");
+        }
+        PyObject *res = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) self->out_size);
+        if (nullptr == res) {
+            PyBuffer_Release(&buf);
+            return nullptr;
+        }
+        char *dst = PyBytes_AS_STRING(res);
+        long us = to_us(timeout);
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->request(buf.buf, (ui) buf.len, dst, self->out_size, us);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (ok) return res;
+        Py_DECREF(res);
+        if (us >= 0 && !tpc::interrupted) Py_RETURN_NONE;
+        return fail(PyExc_OSError, "request failed");
+    }
+
+    // Questions lie in one buffer `in_size` bytes apart, answers come back `out_size` bytes apart
+    PyObject *office_request_batch(OfficeObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"questions", "timeout", nullptr};
+        Py_buffer buf;
+        double timeout = -1;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|d", (char **) kwlist, &buf, &timeout)) return nullptr;
+        ui count = (ui) buf.len / self->in_size;
+        PyObject *res = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) (count * self->out_size));
+        if (nullptr == res) {
+            PyBuffer_Release(&buf);
+            return nullptr;
+        }
+        char *dst = PyBytes_AS_STRING(res);
+        long us = to_us(timeout);
+        ui n;
+        Py_BEGIN_ALLOW_THREADS
+        n = self->ptr->request_batch(buf.buf, self->in_size, dst, self->out_size, count, us);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (n < count && (us < 0 || tpc::interrupted)) {
+            Py_DECREF(res);
+            return fail(PyExc_OSError, "request failed");
+        }
+        if (n != count && 0 != _PyBytes_Resize(&res, (Py_ssize_t) (n * self->out_size))) return nullptr;
+        return res;
+    }
+
+    PyObject *office_look(OfficeObject *self, PyObject *) {
+        PyObject *res = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t) self->in_size);
+        if (nullptr == res) return nullptr;
+        char *dst = PyBytes_AS_STRING(res);
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->look(dst, self->in_size);
+        Py_END_ALLOW_THREADS
+        if (ok) return res;
+        Py_DECREF(res);
+        return fail(PyExc_OSError, "look failed");
+    }
+
+    PyObject *office_answer(OfficeObject *self, PyObject *args) {
+        Py_buffer buf;
+        if (!PyArg_ParseTuple(args, "y*", &buf)) return nullptr;
+        if ((ui) buf.len > self->out_size) {
+            PyBuffer_Release(&buf);
+            return fail(PyExc_ValueError, "answer is bigger than office output size");
+        }
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = self->ptr->answer(buf.buf, (ui) buf.len);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&buf);
+        if (!ok) return fail(PyExc_OSError, "answer failed");
+        Py_RETURN_NONE;
+    }
+
+    PyObject *office_remove(PyObject *, PyObject *args) {
+        const char *name;
+        if (!PyArg_ParseTuple(args, "s", &name)) return nullptr;
+        return PyBool_FromLong(Office::remove(std::string(name)));
+    }
+
+    PyObject *office_questions(OfficeObject *self, void *) {
+        return wrap_box(self->ptr->get_input());
+    }
+
+    PyObject *office_answers(OfficeObject *self, void *) {
+        return wrap_box(self->ptr->get_output());
+    }
+
+    PyMethodDef office_methods[] = {
+        {"ask", (PyCFunction) office_ask, METH_VARARGS | METH_KEYWORDS,
+         "ask(question, timeout=-1) -> bool\nBlocks until the server takes `question`, False after `timeout` seconds."},
+        {"wait", (PyCFunction) office_wait, METH_VARARGS | METH_KEYWORDS,
+         "wait(timeout=-1) -> bytes\nBlocks for the answer, None after `timeout` seconds if not negative."},
+        {"request", (PyCFunction) office_request, METH_VARARGS | METH_KEYWORDS,
+         "request(question, timeout=-1) -> bytes\nask() and wait() with the GIL released once, None after `timeout` "
+         "seconds if not negative."},
+        {"request_batch", (PyCFunction) office_request_batch, METH_VARARGS | METH_KEYWORDS,
+         "request_batch(questions, timeout=-1) -> bytes\nRequests for every `in_size` bytes of `questions` in a row "
+         "with the GIL released once; answers are `out_size` bytes apart, cut short on timeout."},
+        {"look", (PyCFunction) office_look, METH_NOARGS,
+         "look() -> bytes\nServer side: blocks for the next question."},
+        {"answer", (PyCFunction) office_answer, METH_VARARGS,
+         "answer(data)\nServer side: blocks until the client takes the answer."},
+        {"remove", (PyCFunction) office_remove, METH_VARARGS | METH_STATIC,
+         "remove(name) -> bool"},
+        {nullptr}
+    };
+
+    PyGetSetDef office_getset[] = {
+        {"questions", (getter) office_questions, nullptr, (char *) "Box carrying questions to the server", nullptr},
+        {"answers", (getter) office_answers, nullptr, (char *) "Box carrying answers to the client", nullptr},
+        {nullptr}
+    };
+
+    PyTypeObject OfficeType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    // ---- Watcher ----
+
+    struct WatcherObject {
+        PyObject_HEAD
+        std::unique_ptr<tpc::ReadyWatcher> ptr;
+    };
+
+    int watcher_init(WatcherObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"max_sleep", nullptr};
+        double max_sleep = 0.001;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "|d", (char **) kwlist, &max_sleep)) return -1;
+        self->ptr.reset(new tpc::ReadyWatcher(to_us(max_sleep)));
+        if (-1 != self->ptr->fd()) return 0;
+        PyErr_SetString(PyExc_OSError, "cannot start watcher");
+        return -1;
+    }
+
+    // Topic: a message can be taken; Box, Office: a value can be taken (the answer for an office),
+    // or with `writable` a waiting reader can take a value (the server waits for a question)
+    PyObject *watcher_add(WatcherObject *self, PyObject *args, PyObject *kwds) {
+        static const char *kwlist[] = {"source", "writable", "armed", nullptr};
+        PyObject *obj;
+        int writable = 0, armed = 0;
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|pp", (char **) kwlist, &obj, &writable, &armed))
+            return nullptr;
+        tpc::ReadyWatcher::Check check;
+        Box::Ptr box;
+        if (PyObject_TypeCheck(obj, &TopicType)) {
+            Topic::Ptr t = ((TopicObject *) obj)->ptr;
+            check = [t]() { return t->can_sub(); };
+        } else if (PyObject_TypeCheck(obj, &BoxType)) {
+            box = ((BoxObject *) obj)->ptr;
+        } else if (PyObject_TypeCheck(obj, &OfficeType)) {
+            auto office = ((OfficeObject *) obj)->ptr;
+            box = writable ? office->get_input() : office->get_output();
+        } else return fail(PyExc_TypeError, "source should be a Topic, Box or Office");
+        if (nullptr != box) {
+            if (writable) check = [box]() { return box->can_put(); };
+            else check = [box]() { return box->can_get(); };
+        }
+        return PyLong_FromUnsignedLong(self->ptr->add(check, armed));
+    }
+
+    PyObject *watcher_arm(WatcherObject *self, PyObject *args) {
+        unsigned long id;
+        if (!PyArg_ParseTuple(args, "k", &id)) return nullptr;
+        self->ptr->arm(id);
+        Py_RETURN_NONE;
+    }
+
+    PyObject *watcher_remove(WatcherObject *self, PyObject *args) {
+        unsigned long id;
+        if (!PyArg_ParseTuple(args, "k", &id)) return nullptr;
+        self->ptr->remove(id);
+        Py_RETURN_NONE;
+    }
+
+    PyObject *watcher_take(WatcherObject *self, PyObject *) {
+        std::vector<ui> ids = self->ptr->take();
+        PyObject *res = PyList_New((Py_ssize_t) ids.size());
+        if (nullptr == res) return nullptr;
+        for (size_t i = 0; i < ids.size(); i++) PyList_SET_ITEM(res, i, PyLong_FromUnsignedLong(ids[i]));
+        return res;
+    }
+
+    PyObject *watcher_fileno(WatcherObject *self, PyObject *) {
+        return PyLong_FromLong(self->ptr->fd());
+    }
+
+    PyMethodDef watcher_methods[] = {
+        {"add", (PyCFunction) watcher_add, METH_VARARGS | METH_KEYWORDS,
+         "add(source, writable=False, armed=False) -> int\nWatches a Topic, Box or Office, returns its id."},
+        {"arm", (PyCFunction) watcher_arm, METH_VARARGS,
+         "arm(id)\nReports `id` once through fileno() and take() when it becomes ready."},
+        {"remove", (PyCFunction) watcher_remove, METH_VARARGS,
+         "remove(id)"},
+        {"take", (PyCFunction) watcher_take, METH_NOARGS,
+         "take() -> list\nIds found ready since the last call; they are disarmed."},
+        {"fileno", (PyCFunction) watcher_fileno, METH_NOARGS,
+         "fileno() -> int\nEventfd readable while take() has ids, e.g. for loop.add_reader()."},
+        {nullptr}
+    };
+
+    PyTypeObject WatcherType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    // ---- module ----
+
+    PyObject *clap_interrupted(PyObject *, PyObject *) {
+        return PyBool_FromLong(tpc::interrupted);
+    }
+
+    PyObject *clap_registry(PyObject *, PyObject *) {
+        static const char *kinds[] = {"", "topic", "box", "variable"};
+        auto registry = tpc::Registry::get();
+        if (nullptr == registry) return fail(PyExc_OSError, "registry is off or can't be opened");
+        auto all = registry->list();
+        PyObject *res = PyList_New((Py_ssize_t) all.size());
+        if (nullptr == res) return nullptr;
+        for (size_t i = 0; i < all.size(); i++) {
+            auto &info = all[i];
+            PyObject *d = Py_BuildValue("{s:s#,s:s,s:k,s:k,s:i,s:d,s:k}",
+                                        "name", info.name.data(), (Py_ssize_t) info.name.size(),
+                                        "kind", kinds[info.kind < 4 ? info.kind : 0],
+                                        "msg_size", info.msg_size, "msg_count", info.msg_count,
+                                        "pid", (int) info.pid, "created", info.created_ns / 1e9,
+                                        "attached", info.attached);
+            if (nullptr == d) {
+                Py_DECREF(res);
+                return nullptr;
+            }
+            PyList_SET_ITEM(res, (Py_ssize_t) i, d);
+        }
+        return res;
+    }
+
+    PyMethodDef module_methods[] = {
+        {"interrupted", (PyCFunction) clap_interrupted, METH_NOARGS,
+         "interrupted() -> bool\nWhether a signal interrupted blocking calls of this thread."},
+        {"registry", (PyCFunction) clap_registry, METH_NOARGS,
+         "registry() -> list\nTopics, boxes and variables of the registry as dicts: name, kind, msg_size, msg_count, "
+         "pid (creator), created (seconds since the epoch), attached (open handles)."},
+        {nullptr}
+    };
+
+    PyModuleDef clap_module = {PyModuleDef_HEAD_INIT, "clap", "Shared memory pub/sub, variables and boxes.", -1,
+                               module_methods};
+
+    template<typename Obj>
+    bool add_type(PyObject *module, PyTypeObject &type, const char *name, const char *doc, initproc init,
+                  PyMethodDef *methods, PyGetSetDef *getset) {
+        type.tp_name = name;
+        type.tp_doc = doc;
+        type.tp_basicsize = sizeof(Obj);
+        type.tp_flags = Py_TPFLAGS_DEFAULT;
+        type.tp_new = generic_new<Obj>;
+        type.tp_init = init;
+        type.tp_dealloc = generic_dealloc<Obj>;
+        type.tp_methods = methods;
+        type.tp_getset = getset;
+        if (PyType_Ready(&type) < 0) return false;
+        Py_INCREF(&type);
+        return 0 == PyModule_AddObject(module, strrchr(name, '.') + 1, (PyObject *) &type);
+    }
+}
+
+PyMODINIT_FUNC PyInit_clap(void) {
+    PyObject *m = PyModule_Create(&clap_module);
+    if (nullptr == m) return nullptr;
+    SectionType.tp_as_buffer = &section_buffer;
+    TornRead = PyErr_NewException("clap.TornRead", PyExc_RuntimeError, nullptr);
+    Py_XINCREF(TornRead);
+    if (nullptr == TornRead || 0 != PyModule_AddObject(m, "TornRead", TornRead)) {
+        Py_XDECREF(TornRead);
+        Py_DECREF(m);
+        return nullptr;
+    }
+    if (!add_type<TopicObject>(m, TopicType, "clap.Topic",
+                               "Topic(name, msg_size=0, msg_count=0, create=False)",
+                               (initproc) topic_init, topic_methods, topic_getset)
+        || !add_type<VariableObject>(m, VariableType, "clap.Variable",
+                                     "Variable(name, size, mode=RWLOCK, create=True)",
+                                     (initproc) variable_init, variable_methods, variable_getset)
+        || !add_type<BoxObject>(m, BoxType, "clap.Box",
+                                "Box(name, size, create=True)",
+                                (initproc) box_init, box_methods, box_getset)
+        || !add_type<OfficeObject>(m, OfficeType, "clap.Office",
+                                   "Office(name, in_size, out_size, create=False)",
+                                   (initproc) office_init, office_methods, office_getset)
+        || !add_type<WatcherObject>(m, WatcherType, "clap.Watcher",
+                                    "Watcher(max_sleep=0.001)\nOne thread polling topics, boxes and offices with a "
+                                    "backoff of up to `max_sleep` seconds, reporting readiness through an eventfd.",
+                                    (initproc) watcher_init, watcher_methods, nullptr)
+        || !add_type<SectionObject>(m, SectionType, "clap.VariableSection",
+                                    "Zero-copy section of a Variable, see Variable.reading()",
+                                    (initproc) section_init, section_methods, nullptr)) {
+        Py_DECREF(m);
+        return nullptr;
+    }
+    PyModule_AddIntConstant(m, "RWLOCK", Variable::rwlock);
+    PyModule_AddIntConstant(m, "SEQLOCK", Variable::seqlock);
+    PyModule_AddIntConstant(m, "MULTIBUFFER", Variable::multibuffer);
+    PyModule_AddIntConstant(m, "FAIR_RWLOCK", Variable::fair_rwlock);
+    return m;
+}
@@ -0,0 +1,451 @@
+#ifndef PUBSUBCPP_DRAIN_HPP
+#define PUBSUBCPP_DRAIN_HPP
+
+#include "capture.hpp"
+#include <deque>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define TPC_HAVE_IO_URING 1
+#endif
+#endif
+
+// Drains topics into files and sockets from one thread. Messages are taken in batches into
+// buffers as capture::Record + message (padded to 8 bytes), the format of capture segments,
+// and every buffer is written with one request. With io_uring the buffers are registered and
+// the writes of all drains go out with one io_uring_enter per round; without it, each drain
+// writes its ready buffers with one pwritev/writev and waits for blocked sockets with epoll.
+namespace tpc {
+#ifdef TPC_HAVE_IO_URING
+    // io_uring through raw system calls: prepare with next_sqe(), submit with enter()
+    class Ring {
+    public:
+        ~Ring() {
+            if (nullptr != sqes) munmap(sqes, sqes_len);
+            if (nullptr != cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_len);
+            if (nullptr != sq_ptr) munmap(sq_ptr, sq_len);
+            if (-1 != fd) close(fd);
+        }
+
+        bool init(unsigned entries) {
+            struct io_uring_params p;
+            memset(&p, 0, sizeof(p));
+            fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+            if (-1 == fd) return false;
+            sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+            bool single = 0 != (p.features & IORING_FEAT_SINGLE_MMAP);
+            if (single) sq_len = cq_len = std::max(sq_len, cq_len);
+            sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (MAP_FAILED == sq_ptr) return fail(sq_ptr);
+            cq_ptr = single ? sq_ptr : mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                            IORING_OFF_CQ_RING);
+            if (MAP_FAILED == cq_ptr) return fail(cq_ptr);
+            sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+            void *s = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            if (MAP_FAILED == s) return fail(s);
+            sqes = (struct io_uring_sqe *) s;
+            char *sq = (char *) sq_ptr, *cq = (char *) cq_ptr;
+            sq_head = (unsigned *) (sq + p.sq_off.head);
+            sq_tail = (unsigned *) (sq + p.sq_off.tail);
+            sq_mask = *(unsigned *) (sq + p.sq_off.ring_mask);
+            sq_array = (unsigned *) (sq + p.sq_off.array);
+            cq_head = (unsigned *) (cq + p.cq_off.head);
+            cq_tail = (unsigned *) (cq + p.cq_off.tail);
+            cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+            cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+            sq_entries = p.sq_entries;
+            tail = *sq_tail;
+            return true;
+        }
+
+        bool register_buffers(const struct iovec *iov, unsigned count) {
+            return 0 == syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, count);
+        }
+
+        // A cleared entry, nullptr when the submission ring is full
+        struct io_uring_sqe *next_sqe() {
+            if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) return nullptr;
+            unsigned i = tail & sq_mask;
+            sq_array[i] = i;
+            tail++;
+            pending++;
+            memset(&sqes[i], 0, sizeof(sqes[i]));
+            return &sqes[i];
+        }
+
+        // Submits the prepared entries and waits for `wait` completions
+        bool enter(unsigned wait) {
+            __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+            while (true) {
+                long r = syscall(__NR_io_uring_enter, fd, pending, wait, 0 == wait ? 0 : IORING_ENTER_GETEVENTS,
+                                 nullptr, 0);
+                if (r >= 0) {
+                    pending -= (unsigned) r;
+                    return true;
+                }
+                if (EINTR != errno || interrupted) return false;
+            }
+        }
+
+        // Calls f(const io_uring_cqe &) for every completion
+        template<class F>
+        unsigned reap(F f) {
+            unsigned head = *cq_head, n = 0;
+            while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                f(cqes[head & cq_mask]);
+                head++;
+                n++;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            return n;
+        }
+
+    private:
+        bool fail(void *&p) {
+            p = nullptr;
+            return false;
+        }
+
+        int fd = -1;
+        void *sq_ptr = nullptr, *cq_ptr = nullptr;
+        size_t sq_len = 0, cq_len = 0, sqes_len = 0;
+        unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr, *cq_head = nullptr, *cq_tail = nullptr;
+        unsigned sq_mask = 0, cq_mask = 0, sq_entries = 0, tail = 0, pending = 0;
+        struct io_uring_sqe *sqes = nullptr;
+        struct io_uring_cqe *cqes = nullptr;
+    };
+#endif
+
+    class DrainEngine {
+    public:
+        using Ptr = std::shared_ptr<DrainEngine>;
+
+        // Regular files are written from their current offset, anything else as a stream.
+        // Records carry `id` as their topic
+        struct Target {
+            Topic::Ptr topic;
+            int fd;
+            uint32_t id;
+        };
+
+        // `batch` messages per buffer, `depth` buffers per target in flight or ready
+        static Ptr create(const std::vector<Target> &targets, ui batch = 1024, ui depth = 4, bool use_uring = true) {
+            if (targets.empty() || 0 == batch || 0 == depth) return nullptr;
+            Ptr e(new DrainEngine(batch, depth));
+            for (auto &t : targets)
+                if (!e->add(t)) return nullptr;
+#ifdef TPC_HAVE_IO_URING
+            if (use_uring) e->start_uring();
+#endif
+            if (!e->uring && !e->start_fallback()) return nullptr;
+            return e;
+        }
+
+        ~DrainEngine() {
+            if (-1 != epoll_fd) close(epoll_fd);
+            for (auto &o : outs) munmap(o.region, o.region_size);
+        }
+
+        // One round: completes finished writes, takes published messages and writes the ready
+        // buffers. Returns the number of messages taken
+        ui poll() {
+            complete();
+            ui taken = 0;
+            for (auto &o : outs) {
+                while (!o.failed && !o.free.empty()) {
+                    ui n = take(o, o.free.front());
+                    if (0 == n) break;
+                    o.ready.push_back(o.free.front());
+                    o.free.pop_front();
+                    taken += n;
+                }
+            }
+            write();
+            return taken;
+        }
+
+        // poll() until interrupted, sleeping from 10 us to `max_sleep_us` while topics are idle
+        void run(long max_sleep_us = 1000) {
+            long sleep_us = MIN_SLEEP_US;
+            while (!interrupted) {
+                if (0 != poll()) {
+                    sleep_us = MIN_SLEEP_US;
+                    continue;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
+                sleep_us = std::min(sleep_us * 2, max_sleep_us);
+            }
+        }
+
+        // Writes everything taken so far; regular files are left positioned after it
+        bool flush() {
+            while (busy()) {
+                if (interrupted) return false;
+                complete();
+                write();
+                if (!busy()) break;
+#ifdef TPC_HAVE_IO_URING
+                if (uring) {
+                    ring.enter(1);
+                    continue;
+                }
+#endif
+                struct epoll_event ev;
+                epoll_wait(epoll_fd, &ev, 1, 10);
+            }
+            for (auto &o : outs)
+                if (!o.stream) lseek(o.fd, (off_t) o.off, SEEK_SET);
+            return !failed();
+        }
+
+        bool uses_uring() {
+            return uring;
+        }
+
+        // Whether buffers are registered with io_uring
+        bool uses_fixed_buffers() {
+            return fixed;
+        }
+
+        bool failed() {
+            for (auto &o : outs)
+                if (o.failed) return true;
+            return false;
+        }
+
+        // Messages and bytes written
+        ui get_messages() {
+            return messages;
+        }
+
+        ui get_bytes() {
+            return bytes;
+        }
+
+        // Messages the drains lost because publishers overwrote them first
+        ui get_dropped() {
+            ui d = 0;
+            for (auto &o : outs) d += o.topic->get_dropped();
+            return d;
+        }
+
+    private:
+        static const long MIN_SLEEP_US = 10;
+
+        struct Buffer {
+            char *data;
+            ui len, done, count;
+            ui off;                     // file offset of data[0]
+        };
+
+        struct Out {
+            Topic::Ptr topic;
+            int fd;
+            uint32_t id;
+            bool stream;
+            ui off;
+            char *region;
+            ui region_size;
+            std::vector<Buffer> bufs;
+            std::deque<ui> free, ready;
+            ui in_flight;
+            bool blocked, failed;
+        };
+
+        DrainEngine(ui batch, ui depth) {
+            this->batch = batch;
+            this->depth = depth;
+        }
+
+        bool add(const Target &t) {
+            if (nullptr == t.topic || -1 == t.fd) return false;
+            struct stat st;
+            if (-1 == fstat(t.fd, &st)) return Err("Cannot stat drain output");
+            Out o;
+            o.topic = t.topic;
+            o.fd = t.fd;
+            o.id = t.id;
+            o.stream = !S_ISREG(st.st_mode);
+            off_t pos = o.stream ? 0 : lseek(t.fd, 0, SEEK_CUR);
+            o.off = pos > 0 ? (ui) pos : 0;
+            ui buf_size = batch * capture::record_size(t.topic->get_msg_size());
+            o.region_size = buf_size * depth;
+            void *p = mmap(nullptr, o.region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+            if (MAP_FAILED == p) return Err("Cannot allocate drain buffers");
+            o.region = (char *) p;
+            for (ui i = 0; i < depth; i++) {
+                o.bufs.push_back(Buffer{o.region + i * buf_size, 0, 0, 0, 0});
+                o.free.push_back(i);
+            }
+            o.in_flight = 0;
+            o.blocked = o.failed = false;
+            outs.push_back(o);
+            return true;
+        }
+
+        ui take(Out &o, ui b) {
+            Buffer &buf = o.bufs[b];
+            char *p = buf.data;
+            Topic::MsgInfo info;
+            ui n = 0;
+            while (n < batch) {
+                ui size = o.topic->sub(p + sizeof(capture::Record), info, 0);
+                if (0 == size) break;
+                auto r = (capture::Record *) p;
+                *r = capture::Record{o.id, (uint32_t) size, info.seq, info.time_ns};
+                ui rs = capture::record_size(size);
+                memset(p + sizeof(capture::Record) + size, 0, rs - sizeof(capture::Record) - size);
+                p += rs;
+                n++;
+            }
+            buf.len = (ui) (p - buf.data);
+            buf.done = 0;
+            buf.count = n;
+            return n;
+        }
+
+        bool busy() {
+            for (auto &o : outs)
+                if (!o.failed && (o.in_flight > 0 || !o.ready.empty())) return true;
+            return false;
+        }
+
+        // A fully written buffer goes back to the free list
+        void written(Out &o, ui b) {
+            messages += o.bufs[b].count;
+            bytes += o.bufs[b].len;
+            o.free.push_back(b);
+        }
+
+        void drain_failed(Out &o, int error) {
+            if (!o.failed) Err("Drain of " + o.topic->get_name() + " failed: " + strerror(error));
+            o.failed = true;
+        }
+
+        void complete() {
+#ifdef TPC_HAVE_IO_URING
+            if (uring) {
+                ring.reap([this](const struct io_uring_cqe &c) {
+                    Out &o = outs[c.user_data >> 32];
+                    ui b = c.user_data & 0xffffffff;
+                    Buffer &buf = o.bufs[b];
+                    o.in_flight--;
+                    if (c.res < 0 && -EAGAIN != c.res && -EINTR != c.res) {
+                        drain_failed(o, -c.res);
+                        return;
+                    }
+                    if (c.res > 0) buf.done += c.res;
+                    if (buf.done == buf.len) written(o, b);
+                    else o.ready.push_front(b);     // short write, the rest goes first
+                });
+                return;
+            }
+#endif
+            struct epoll_event evs[16];
+            int n = epoll_wait(epoll_fd, evs, 16, 0);
+            for (int i = 0; i < n; i++) outs[evs[i].data.u64].blocked = false;
+        }
+
+        void write() {
+#ifdef TPC_HAVE_IO_URING
+            if (uring) {
+                bool submit = false;
+                for (ui i = 0; i < outs.size(); i++) {
+                    Out &o = outs[i];
+                    // A stream takes one write at a time, so a short write can't reorder records
+                    while (!o.failed && !o.ready.empty() && !(o.stream && o.in_flight > 0)) {
+                        struct io_uring_sqe *s = ring.next_sqe();
+                        if (nullptr == s) break;
+                        ui b = o.ready.front();
+                        o.ready.pop_front();
+                        Buffer &buf = o.bufs[b];
+                        if (0 == buf.done) {
+                            buf.off = o.off;
+                            o.off += buf.len;
+                        }
+                        s->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                        s->fd = o.fd;
+                        s->addr = (uint64_t) (buf.data + buf.done);
+                        s->len = (uint32_t) (buf.len - buf.done);
+                        s->off = o.stream ? (uint64_t) -1 : buf.off + buf.done;
+                        if (fixed) s->buf_index = (uint16_t) i;
+                        s->user_data = (i << 32) | b;
+                        o.in_flight++;
+                        submit = true;
+                    }
+                }
+                if (submit && !ring.enter(0)) Err("Cannot submit drain writes");
+                return;
+            }
+#endif
+            std::vector<struct iovec> iov;
+            for (auto &o : outs) {
+                if (o.failed || o.blocked || o.ready.empty()) continue;
+                iov.clear();
+                for (ui b : o.ready) {
+                    Buffer &buf = o.bufs[b];
+                    iov.push_back({buf.data + buf.done, buf.len - buf.done});
+                    if (iov.size() == IOV_MAX) break;
+                }
+                ssize_t r = o.stream ? writev(o.fd, iov.data(), (int) iov.size())
+                                     : pwritev(o.fd, iov.data(), (int) iov.size(), (off_t) o.off);
+                if (-1 == r) {
+                    if (EAGAIN == errno || EWOULDBLOCK == errno) o.blocked = true;
+                    else if (EINTR != errno) drain_failed(o, errno);
+                    continue;
+                }
+                if (!o.stream) o.off += (ui) r;
+                while (r > 0) {
+                    Buffer &buf = o.bufs[o.ready.front()];
+                    ui part = std::min((ui) r, buf.len - buf.done);
+                    buf.done += part;
+                    r -= (ssize_t) part;
+                    if (buf.done < buf.len) break;
+                    written(o, o.ready.front());
+                    o.ready.pop_front();
+                }
+            }
+        }
+
+#ifdef TPC_HAVE_IO_URING
+        void start_uring() {
+            if (!ring.init((unsigned) (outs.size() * depth))) return;
+            uring = true;
+            std::vector<struct iovec> iov;
+            for (auto &o : outs) iov.push_back({o.region, o.region_size});
+            // Registered buffers count against RLIMIT_MEMLOCK; plain writes do without them
+            fixed = iov.size() <= UINT16_MAX && ring.register_buffers(iov.data(), (unsigned) iov.size());
+        }
+#endif
+
+        // Streams become non-blocking, epoll tells when they take data again
+        bool start_fallback() {
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (-1 == epoll_fd) return Err("Cannot create drain epoll");
+            for (ui i = 0; i < outs.size(); i++) {
+                if (!outs[i].stream) continue;
+                fcntl(outs[i].fd, F_SETFL, fcntl(outs[i].fd, F_GETFL) | O_NONBLOCK);
+                struct epoll_event ev;
+                ev.events = EPOLLOUT | EPOLLET;
+                ev.data.u64 = i;
+                if (-1 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, outs[i].fd, &ev)) return Err("Cannot watch drain output");
+            }
+            return true;
+        }
+
+        ui batch, depth;
+        std::vector<Out> outs;
+        bool uring = false, fixed = false;
+#ifdef TPC_HAVE_IO_URING
+        Ring ring;
+#endif
+        int epoll_fd = -1;
+        ui messages = 0, bytes = 0;
+    };
+}
+
+#endif //PUBSUBCPP_DRAIN_HPP
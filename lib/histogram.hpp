@@ -0,0 +1,95 @@
+#ifndef PUBSUBCPP_HISTOGRAM_HPP
+#define PUBSUBCPP_HISTOGRAM_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <iostream>
+
+namespace tpc {
+    // Log-linear (HDR-style) histogram of non-negative integer values.
+    // Every power-of-two range is split into SUB linear buckets, so the
+    // relative error of a reported value is below 1/SUB for any magnitude.
+    class Histogram {
+    public:
+        static const int SUB_BITS = 7;
+        static const uint64_t SUB = 1ull << SUB_BITS;
+
+        Histogram() : counts(SUB + (64 - SUB_BITS) * SUB, 0) {}
+
+        void record(uint64_t value) {
+            counts[index(value)]++;
+            total++;
+            sum += value;
+            if (value > max_value) max_value = value;
+            if (value < min_value) min_value = value;
+        }
+
+        void merge(const Histogram &other) {
+            for (size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+            total += other.total;
+            sum += other.sum;
+            if (other.max_value > max_value) max_value = other.max_value;
+            if (other.min_value < min_value) min_value = other.min_value;
+        }
+
+        uint64_t count() const { return total; }
+
+        uint64_t max() const { return total ? max_value : 0; }
+
+        uint64_t min() const { return total ? min_value : 0; }
+
+        double mean() const { return total ? (double) sum / total : 0; }
+
+        // Highest value equivalent to the bucket holding the q-th quantile, q in [0, 1]
+        uint64_t percentile(double q) const {
+            if (0 == total) return 0;
+            auto rank = (uint64_t) (q * total + 0.5);
+            if (rank < 1) rank = 1;
+            if (rank > total) rank = total;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                seen += counts[i];
+                if (seen >= rank) {
+                    uint64_t hi = highest(i);
+                    return hi < max_value ? hi : max_value;
+                }
+            }
+            return max_value;
+        }
+
+        // Prints the usual latency summary, values divided by `scale` (e.g. 1000 for ns -> us)
+        void print(std::ostream &out, const std::string &unit, double scale) const {
+            static const double qs[] = {0.5, 0.9, 0.99, 0.999, 0.9999};
+            char line[128];
+            snprintf(line, sizeof(line), "count=%lu min=%.2f mean=%.2f max=%.2f (%s)",
+                     (unsigned long) total, min() / scale, mean() / scale, max() / scale, unit.c_str());
+            out << line << std::endl;
+            for (double q : qs) {
+                snprintf(line, sizeof(line), "  p%-7g %12.2f", q * 100, percentile(q) / scale);
+                out << line << std::endl;
+            }
+        }
+
+    private:
+        static size_t index(uint64_t v) {
+            if (v < SUB) return (size_t) v;
+            int msb = 63 - __builtin_clzll(v);
+            int shift = msb - SUB_BITS;
+            return (size_t) (SUB + shift * SUB + ((v >> shift) - SUB));
+        }
+
+        static uint64_t highest(size_t i) {
+            if (i < SUB) return i;
+            uint64_t shift = (i - SUB) / SUB;
+            uint64_t sub = (i - SUB) % SUB + SUB;
+            return ((sub + 1) << shift) - 1;
+        }
+
+        std::vector<uint64_t> counts;
+        uint64_t total = 0, sum = 0, max_value = 0, min_value = UINT64_MAX;
+    };
+}
+
+#endif //PUBSUBCPP_HISTOGRAM_HPP
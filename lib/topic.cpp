@@ -65,6 +65,22 @@ extern "C" {
         Py_END_ALLOW_THREADS
         return result;
     }
+    // Up to `max` messages, `msg_size` bytes apart in `msgs`, with the GIL released once.
+    // Waits up to `timeout_us` (negative - forever) for the first one; returns the count.
+    ui topicSubBatch(TopStruct *t, char *msgs, ui max, ui *sizes, long timeout_us) {
+        ui result;
+        Py_BEGIN_ALLOW_THREADS
+        result = t->ptr->sub_batch(msgs, max, sizes, timeout_us);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    ui topicSubTimeout(TopStruct *t, const char *msg, long timeout_us) {
+        ui result;
+        Py_BEGIN_ALLOW_THREADS
+        result = t->ptr->sub(msg, timeout_us);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
     bool topicSpawn(TopStruct *t, const char *name, ui size, ui count){
         std::string n(name);
         TopPtr ptr;
@@ -86,6 +102,140 @@ extern "C" {
         std::string n(name);
         return Topic::remove(n);
     }
+
+    using BoxPtr = Box::Ptr;
+    size_t BoxPtrSize = sizeof(BoxPtr);
+    size_t boxPtrSize(){ return BoxPtrSize; }
+    struct BoxStruct { public: explicit BoxStruct(BoxPtr &&b) {ptr = b;} BoxPtr ptr;};
+    bool boxIsNull(BoxStruct *b){return b->ptr == nullptr;}
+    ui boxSize(BoxStruct *b){return b->ptr->get_size();}
+    // `size` 0 means the whole box; `timeout_us` negative - wait forever
+    bool boxPut(BoxStruct *b, const char *data, ui size, long timeout_us){
+        bool result;
+        if (size == 0) size = b->ptr->get_size();
+        Py_BEGIN_ALLOW_THREADS
+        if (timeout_us < 0) result = b->ptr->put((void *) data, size);
+        else result = b->ptr->put((void *) data, size, timeout_us);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    bool boxGet(BoxStruct *b, char *data, ui size, long timeout_us){
+        bool result;
+        if (size == 0) size = b->ptr->get_size();
+        Py_BEGIN_ALLOW_THREADS
+        if (timeout_us < 0) result = b->ptr->get(data, size);
+        else result = b->ptr->get(data, size, timeout_us);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    // `count` values `size` bytes apart in `data` with the GIL released once; returns the count moved
+    ui boxPutBatch(BoxStruct *b, const char *data, ui size, ui count){
+        ui n = 0;
+        Py_BEGIN_ALLOW_THREADS
+        while (n < count && b->ptr->put((void *) (data + n * size), size)) n++;
+        Py_END_ALLOW_THREADS
+        return n;
+    }
+    ui boxGetBatch(BoxStruct *b, char *data, ui size, ui count){
+        ui n = 0;
+        Py_BEGIN_ALLOW_THREADS
+        while (n < count && b->ptr->get(data + n * size, size)) n++;
+        Py_END_ALLOW_THREADS
+        return n;
+    }
+    bool boxTryPut(BoxStruct *b, const char *data, ui size){return b->ptr->try_put((void *) data, size);}
+    void boxOffer(BoxStruct *b){b->ptr->offer();}
+    bool boxTryGet(BoxStruct *b, char *data, ui size){return b->ptr->try_get(data, size);}
+    void boxWithdraw(BoxStruct *b){
+        Py_BEGIN_ALLOW_THREADS
+        b->ptr->withdraw();
+        Py_END_ALLOW_THREADS
+    }
+    bool boxCreate(BoxStruct *b, const char *name, ui size){
+        std::string n(name);
+        BoxPtr ptr = Box::open_create(n, size);
+        b->ptr = ptr;
+        return ptr != nullptr;
+    }
+    bool boxOpen(BoxStruct *b, const char *name, ui size){
+        std::string n(name);
+        BoxPtr ptr = Box::just_open(n, size);
+        b->ptr = ptr;
+        return ptr != nullptr;
+    }
+    bool boxRemove(const char *name){
+        std::string n(name);
+        return Box::remove(n);
+    }
+
+    using OffPtr = Office::Ptr;
+    size_t OffPtrSize = sizeof(OffPtr);
+    size_t officePtrSize(){ return OffPtrSize; }
+    struct OffStruct { public: explicit OffStruct(OffPtr &&o) {ptr = o;} OffPtr ptr;};
+    bool officeIsNull(OffStruct *o){return o->ptr == nullptr;}
+    bool officeAsk(OffStruct *o, const char *question, ui size, long timeout_us){
+        bool result;
+        Py_BEGIN_ALLOW_THREADS
+        if (timeout_us < 0) result = o->ptr->ask((void *) question, size);
+        else result = o->ptr->ask((void *) question, size, timeout_us);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    bool officeWait(OffStruct *o, char *answer, ui size, long timeout_us){
+        bool result;
+        Py_BEGIN_ALLOW_THREADS
+        if (timeout_us < 0) result = o->ptr->wait(answer, size);
+        else result = o->ptr->wait(answer, size, timeout_us);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    // ask + wait in one call
+    bool officeRequest(OffStruct *o, const char *question, ui q_size, char *answer, ui a_size, long timeout_us){
+        bool result;
+        Py_BEGIN_ALLOW_THREADS
+        result = o->ptr->request((void *) question, q_size, answer, a_size, timeout_us);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    // `count` requests, questions `q_size` and answers `a_size` bytes apart; returns the count answered
+    ui officeRequestBatch(OffStruct *o, const char *questions, ui q_size, char *answers, ui a_size, ui count,
+                          long timeout_us){
+        ui result;
+        Py_BEGIN_ALLOW_THREADS
+        result = o->ptr->request_batch(questions, q_size, answers, a_size, count, timeout_us);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    bool officeLook(OffStruct *o, char *question, ui size){
+        bool result;
+        Py_BEGIN_ALLOW_THREADS
+        result = o->ptr->look(question, size);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    bool officeAnswer(OffStruct *o, const char *answer, ui size){
+        bool result;
+        Py_BEGIN_ALLOW_THREADS
+        result = o->ptr->answer((void *) answer, size);
+        Py_END_ALLOW_THREADS
+        return result;
+    }
+    bool officeCreate(OffStruct *o, const char *name, ui in_size, ui out_size){
+        std::string n(name);
+        OffPtr ptr = Office::open_create(n, in_size, out_size);
+        o->ptr = ptr;
+        return ptr != nullptr;
+    }
+    bool officeOpen(OffStruct *o, const char *name, ui in_size, ui out_size){
+        std::string n(name);
+        OffPtr ptr = Office::just_open(n, in_size, out_size);
+        o->ptr = ptr;
+        return ptr != nullptr;
+    }
+    bool officeRemove(const char *name){
+        std::string n(name);
+        return Office::remove(n);
+    }
 };
 
 
@@ -1,5 +1,7 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
 #include <semaphore.h>
 #include <csignal>
 #include <unistd.h>
@@ -8,8 +10,21 @@
 #include <cstring>
 #include <memory>
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <cerrno>
 #include <iostream>
+#include <atomic>
+#include <climits>
+#include <sched.h>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include "debug.hpp"
 
 #ifdef DEBUG
@@ -189,11 +204,26 @@ namespace tpc {
         return std::make_shared<Semaphore>(name);
     }
 
+    // CLOCK_REALTIME point `timeout_us` from now, as sem_timedwait() takes it
+    struct timespec wall_deadline(long timeout_us) {
+        struct timespec at;
+        clock_gettime(CLOCK_REALTIME, &at);
+        at.tv_sec += timeout_us / 1000000;
+        at.tv_nsec += (timeout_us % 1000000) * 1000;
+        if (at.tv_nsec >= 1000000000) { at.tv_sec++; at.tv_nsec -= 1000000000; }
+        return at;
+    }
+
+    // sem_wait(), or sem_timedwait() until `at` if given
+    int sem_wait_until(sem_t *sem, const struct timespec *at) {
+        return nullptr == at ? sem_wait(sem) : sem_timedwait(sem, at);
+    }
+
     class Lock {
     public:
-        explicit Lock(sem_t *sem) {
+        explicit Lock(sem_t *sem, const struct timespec *at = nullptr) {
             this->sem = sem;
-            locked = -1 != sem_wait(sem);
+            locked = -1 != sem_wait_until(sem, at);
         }
 
         ~Lock() {
@@ -207,15 +237,17 @@ namespace tpc {
 
     class ReadersLock {
     public:
-        ReadersLock(sem_t *sem, ui *counter, sem_t *cond) {
+        // Gives up at `at` (CLOCK_REALTIME) if given
+        ReadersLock(sem_t *sem, ui *counter, sem_t *cond, const struct timespec *at = nullptr) {
             this->counter = counter;
             this->cond = cond;
             this->sem = sem;
-            auto l = Lock(sem);
+            auto l = Lock(sem, at);
+            if (!l.locked) return;
             DEBUG_MSG(" Rcounter(c0): " << *counter, DF3);
             if (1 == ++*counter) {
                 DEBUG_MSG("1reader", DF3);
-                if (-1 == sem_wait(cond)) {
+                if (-1 == sem_wait_until(cond, at)) {
                     --*counter;
                     DEBUG_MSG("cannot lock writer's lock while reading", DF3);
                     locked = false;
@@ -243,14 +275,17 @@ namespace tpc {
 
     class WriterLock {
     public:
-        WriterLock(sem_t *sem, ui *counter, sem_t **lim, ui lim_count) {
+        // `seq`, if given, is a publish counter advanced together with `counter`, its value lands in `ticket`
+        WriterLock(sem_t *sem, ui *counter, sem_t **lim, ui lim_count, ui *seq = nullptr) {
             this->lim = lim;
             auto l = Lock(sem);
             pos = (*counter)++;
+            if (nullptr != seq) ticket = (*seq)++;
             DEBUG_MSG("Writer pos: " << pos, DF2);
             *counter %= lim_count;
             DEBUG_MSG("Next: " << *counter, DF3);
             if (-1 == sem_wait(lim[*counter])) {
+                if (nullptr != seq) (*seq)--;
                 (*counter)--;
                 *counter %= lim_count;
                 pos = *counter;
@@ -266,7 +301,7 @@ namespace tpc {
 
         bool locked = false;
         sem_t **lim;
-        ui pos;
+        ui pos, ticket = 0;
     };
 
     class DataForSemaphoreArray {
@@ -342,6 +377,474 @@ namespace tpc {
         ui *counter;
     };
 
+    static const ui CACHE_LINE = 64;
+
+    // Sleeps while *addr == expected. Works across processes for words in shared memory.
+    // Returns false on timeout or interruption, true otherwise (including spurious wake ups).
+    bool futex_wait(std::atomic<uint32_t> *addr, uint32_t expected, const struct timespec *timeout = nullptr) {
+        long res = syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAIT, expected, timeout, nullptr, 0);
+        return !(-1 == res && (ETIMEDOUT == errno || EINTR == errno));
+    }
+
+    void futex_wake(std::atomic<uint32_t> *addr, int count = INT_MAX) {
+        syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAKE, count, nullptr, nullptr, 0);
+    }
+
+    // CLOCK_MONOTONIC nanoseconds, comparable between processes of one machine
+    int64_t monotonic_ns() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    }
+
+    // CLOCK_REALTIME nanoseconds since the epoch
+    int64_t realtime_ns() {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    }
+
+    // Point in CLOCK_MONOTONIC time `timeout_us` from now; negative timeout never expires
+    class Deadline {
+    public:
+        explicit Deadline(long timeout_us = -1) {
+            infinite = timeout_us < 0;
+            if (infinite) return;
+            clock_gettime(CLOCK_MONOTONIC, &at);
+            at.tv_sec += timeout_us / 1000000;
+            at.tv_nsec += (timeout_us % 1000000) * 1000;
+            if (at.tv_nsec >= 1000000000) { at.tv_sec++; at.tv_nsec -= 1000000000; }
+        }
+        // Relative timeout for futex_wait(): nullptr if infinite, false if already expired
+        bool left(const struct timespec *&timeout) {
+            timeout = nullptr;
+            if (infinite) return true;
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            rest.tv_sec = at.tv_sec - now.tv_sec;
+            rest.tv_nsec = at.tv_nsec - now.tv_nsec;
+            if (rest.tv_nsec < 0) { rest.tv_sec--; rest.tv_nsec += 1000000000; }
+            if (rest.tv_sec < 0) return false;
+            timeout = &rest;
+            return true;
+        }
+        bool expired() {
+            const struct timespec *t;
+            return !left(t);
+        }
+        // Microseconds left, -1 if infinite
+        long left_us() {
+            if (infinite) return -1;
+            int64_t us = (ns() - monotonic_ns()) / 1000;
+            return us > 0 ? (long) us : 0;
+        }
+        // As monotonic_ns() value, 0 if infinite
+        int64_t ns() {
+            return infinite ? 0 : (int64_t) at.tv_sec * 1000000000 + at.tv_nsec;
+        }
+    private:
+        bool infinite;
+        struct timespec at, rest;
+    };
+
+    // Mutex on a shared 32-bit word: 0 - free, 1 - locked, 2 - locked with sleepers
+    class FutexLock {
+    public:
+        explicit FutexLock(std::atomic<uint32_t> *word) {
+            this->word = word;
+            lock(word);
+        }
+
+        ~FutexLock() {
+            unlock(word);
+        }
+
+        static void lock(std::atomic<uint32_t> *word) {
+            uint32_t c = 0;
+            if (word->compare_exchange_strong(c, 1, std::memory_order_acquire)) return;
+            if (2 != c) c = word->exchange(2, std::memory_order_acquire);
+            while (0 != c) {
+                futex_wait(word, 2);
+                c = word->exchange(2, std::memory_order_acquire);
+            }
+        }
+
+        static void unlock(std::atomic<uint32_t> *word) {
+            if (1 != word->fetch_sub(1, std::memory_order_release)) {
+                word->store(0, std::memory_order_release);
+                futex_wake(word, 1);
+            }
+        }
+
+        std::atomic<uint32_t> *word;
+    };
+
+    // Writer-preferring readers/writer lock on two shared words. Once a writer is queued new
+    // readers wait, so a writer only waits for the readers already inside. Writers are
+    // serialized by a FutexLock on `wlock`.
+    class FairRWLock {
+    public:
+        static const uint32_t WRITER_ACTIVE = 1u << 31;
+        static const uint32_t WRITER_WAITING = 1u << 30;
+        static const uint32_t READERS = WRITER_WAITING - 1;
+
+        FairRWLock(std::atomic<uint32_t> *state, std::atomic<uint32_t> *wlock) {
+            this->state = state;
+            this->wlock = wlock;
+        }
+
+        bool reader_lock() {
+            uint32_t s = state->load(std::memory_order_relaxed);
+            while (true) {
+                if (s & (WRITER_ACTIVE | WRITER_WAITING)) {
+                    if (interrupted) return false;
+                    futex_wait(state, s);
+                    s = state->load(std::memory_order_relaxed);
+                } else if (state->compare_exchange_weak(s, s + 1, std::memory_order_acquire)) break;
+            }
+            mode = in_read;
+            return true;
+        }
+
+        bool writer_lock() {
+            FutexLock::lock(wlock);
+            uint32_t s = state->fetch_or(WRITER_WAITING, std::memory_order_seq_cst) | WRITER_WAITING;
+            while (true) {
+                if (s & READERS) {
+                    futex_wait(state, s);
+                    s = state->load(std::memory_order_relaxed);
+                } else if (state->compare_exchange_weak(s, WRITER_ACTIVE, std::memory_order_acquire)) break;
+            }
+            mode = in_write;
+            return true;
+        }
+
+        ~FairRWLock() {
+            if (in_read == mode) {
+                uint32_t s = state->fetch_sub(1, std::memory_order_release) - 1;
+                if (0 == (s & READERS) && (s & WRITER_WAITING)) futex_wake(state);
+            } else if (in_write == mode) {
+                state->fetch_and(~WRITER_ACTIVE, std::memory_order_release);
+                futex_wake(state);
+                FutexLock::unlock(wlock);
+            }
+        }
+
+        std::atomic<uint32_t> *state, *wlock;
+        enum {state_free, in_read, in_write} mode = state_free;
+    };
+
+    static const int SEQ_SPIN = 100;
+
+    // Seqlock writer side: makes the sequence odd, excluding other writers (they sleep on `seq`)
+    bool seq_writer_enter(std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiters, uint32_t &s) {
+        s = seq->load(std::memory_order_relaxed);
+        while ((s & 1) || !seq->compare_exchange_weak(s, s + 1, std::memory_order_acq_rel)) {
+            if (0 == (s & 1)) continue;
+            waiters->fetch_add(1, std::memory_order_seq_cst);
+            futex_wait(seq, s);
+            waiters->fetch_sub(1, std::memory_order_seq_cst);
+            if (interrupted) return false;
+            s = seq->load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
+    }
+
+    void seq_writer_leave(std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiters, uint32_t s) {
+        seq->store(s + 2, std::memory_order_seq_cst);
+        if (waiters->load(std::memory_order_seq_cst)) futex_wake(seq);
+    }
+
+    // Seqlock reader side: repeats copy() until no writer interfered with it
+    template<typename F>
+    bool seq_read(std::atomic<uint32_t> *seq, F copy) {
+        for (int spins = 0; ; spins++) {
+            uint32_t s = seq->load(std::memory_order_acquire);
+            if (0 == (s & 1)) {
+                copy();
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq->load(std::memory_order_relaxed) == s) return true;
+            }
+            if (interrupted) return false;
+            if (spins > SEQ_SPIN) sched_yield();
+        }
+    }
+
+    // Topics, boxes and variables of the machine in one shared memory segment (/clap-registry,
+    // or $CLAP_REGISTRY; set it empty to turn the registry off). Creating and removing them keeps
+    // it up to date, every open object counts as an attached handle. Entries live in an open
+    // addressing table hashed by name and are seqlocked, so find() and list() never block or
+    // enter the kernel. Nothing waits on an entry for long: one that stays locked is skipped, and
+    // one left locked by a writer that died is taken over and dropped.
+    class Registry {
+        struct Entry;
+
+    public:
+        enum Kind : uint32_t {empty = 0, topic = 1, box = 2, variable = 3, removed = 4};
+        static const ui CAPACITY = 4096;
+        static const ui NAME_SIZE = 104;
+
+        struct Info {
+            std::string name;
+            Kind kind;
+            ui msg_size, msg_count;
+            pid_t pid;              // of the creator
+            int64_t created_ns;     // CLOCK_REALTIME
+            ui attached;            // open handles; those of processes that died stay counted
+        };
+
+        // An open handle of a registered object, detached when destroyed
+        class Attachment {
+        public:
+            Attachment(Entry *e, uint32_t seq) : e(e), seq(seq) {}
+
+            ~Attachment() {
+                // Only the same incarnation of the entry, not one re-added since
+                if (e->seq.load(std::memory_order_acquire) == seq) e->attached.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+        private:
+            Entry *e;
+            uint32_t seq;
+        };
+
+        using Attach = std::shared_ptr<Attachment>;
+
+        // The registry of this process, nullptr when it is off or can't be mapped
+        static Registry *get() {
+            static Registry *r = open();
+            return r;
+        }
+
+        // Hooks of the objects' create, remove and open calls
+        static void on_create(const std::string &name, Kind kind, ui msg_size, ui msg_count) {
+            if (nullptr != get()) get()->add(name, kind, msg_size, msg_count);
+        }
+
+        static void on_remove(const std::string &name) {
+            if (nullptr != get()) get()->remove(name);
+        }
+
+        static Attach on_open(const std::string &name) {
+            return nullptr == get() ? nullptr : get()->attach(name);
+        }
+
+        // Replaces an entry of the same name
+        bool add(const std::string &name, Kind kind, ui msg_size, ui msg_count) {
+            if (name.size() >= NAME_SIZE) return Err("Name is too long for the registry: " + name);
+            remove(name);
+            Meta m;
+            ui h = hash(name);
+            for (ui k = 0; k < CAPACITY; k++) {
+                Entry &e = entries[(h + k) % CAPACITY];
+                if (!snapshot(e, m) || (empty != m.kind && removed != m.kind)) continue;
+                uint32_t s;
+                if (!enter(e, s)) continue;
+                if (empty != e.meta.kind && removed != e.meta.kind) {
+                    leave(e, s);
+                    continue;
+                }
+                e.meta.kind = kind;
+                e.meta.pid = getpid();
+                e.meta.msg_size = msg_size;
+                e.meta.msg_count = msg_count;
+                e.meta.created_ns = realtime_ns();
+                memset(e.meta.name, 0, NAME_SIZE);
+                memcpy(e.meta.name, name.data(), name.size());
+                e.attached.store(0, std::memory_order_relaxed);
+                leave(e, s);
+                return true;
+            }
+            return Err("Registry is full");
+        }
+
+        bool remove(const std::string &name) {
+            bool found = false;
+            Meta m;
+            ui h = hash(name);
+            for (ui k = 0; k < CAPACITY; k++) {
+                Entry &e = entries[(h + k) % CAPACITY];
+                if (!snapshot(e, m)) continue;
+                if (empty == m.kind) break;
+                if (!live(m, name)) continue;
+                uint32_t s;
+                if (!enter(e, s)) continue;
+                if (live(e.meta, name)) {
+                    e.meta.kind = removed;      // keeps the probe chain through this slot
+                    e.attached.store(0, std::memory_order_relaxed);
+                    found = true;
+                }
+                leave(e, s);
+            }
+            return found;
+        }
+
+        bool find(const std::string &name, Info &info) {
+            return nullptr != lookup(name, info);
+        }
+
+        // Every registered object
+        std::vector<Info> list() {
+            std::vector<Info> res;
+            Meta m;
+            for (ui i = 0; i < CAPACITY; i++) {
+                if (!snapshot(entries[i], m) || !live(m)) continue;
+                res.push_back(info(m, entries[i]));
+            }
+            return res;
+        }
+
+        Attach attach(const std::string &name) {
+            Info i;
+            Entry *e = lookup(name, i);
+            if (nullptr == e) return nullptr;
+            uint32_t s = e->seq.load(std::memory_order_acquire);
+            if (s & 1) return nullptr;
+            e->attached.fetch_add(1, std::memory_order_relaxed);
+            return std::make_shared<Attachment>(e, s);
+        }
+
+    private:
+        struct Meta {
+            uint32_t kind;
+            int32_t pid;
+            ui msg_size, msg_count;
+            int64_t created_ns;
+            char name[NAME_SIZE];
+        };
+
+        struct Entry {
+            std::atomic<uint32_t> seq;
+            std::atomic<int32_t> writer;        // pid of the process that locked the entry last
+            std::atomic<uint32_t> attached;
+            Meta meta;
+        };
+
+        static const uint64_t MAGIC = 0x3147455250414c43ull;   // "CLAPREG1"
+        static const ui HEADER_SIZE = 64;
+        static const int MAX_SPINS = 1000;      // before a locked entry counts as unavailable
+
+        static Registry *open() {
+            const char *env = getenv("CLAP_REGISTRY");
+            std::string name = nullptr == env ? "/clap-registry" : env;
+            if (name.empty()) return nullptr;
+            auto mem = ShmMake(name, HEADER_SIZE + CAPACITY * sizeof(Entry));
+            // Another process may be between creating and sizing the segment
+            for (int tries = 0; !mem->is_open() && tries < 100; tries++) {
+                if (!mem->exists()) mem->create();
+                if (!mem->open(false)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (!mem->is_open()) {
+                Err("Cannot open registry " + name);
+                return nullptr;
+            }
+            // Zeroed memory is an empty registry
+            auto magic = (std::atomic<uint64_t> *) mem->data;
+            uint64_t found = 0;
+            if (!magic->compare_exchange_strong(found, MAGIC) && MAGIC != found) {
+                Err("Registry " + name + " has a foreign layout");
+                return nullptr;
+            }
+            auto r = new Registry();
+            r->mem = mem;
+            r->entries = (Entry *) ((char *) mem->data + HEADER_SIZE);
+            return r;
+        }
+
+        // FNV-1a, the same in every process
+        static ui hash(const std::string &name) {
+            uint64_t h = 14695981039346656037ull;
+            for (unsigned char c : name) h = (h ^ c) * 1099511628211ull;
+            return h % CAPACITY;
+        }
+
+        static bool live(const Meta &m) {
+            return empty != m.kind && removed != m.kind;
+        }
+
+        static bool live(const Meta &m, const std::string &name) {
+            return live(m) && 0 == strncmp(m.name, name.c_str(), NAME_SIZE);
+        }
+
+        // Seqlock reader, false if the entry stays locked
+        bool snapshot(Entry &e, Meta &m) {
+            for (int spins = 0; spins < MAX_SPINS; spins++) {
+                uint32_t s = e.seq.load(std::memory_order_acquire);
+                if (0 == (s & 1)) {
+                    m = e.meta;
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (e.seq.load(std::memory_order_relaxed) == s) return true;
+                } else if (spins > SEQ_SPIN) {
+                    recover(e, s);
+                    sched_yield();
+                }
+                if (interrupted) return false;
+            }
+            return false;
+        }
+
+        // Seqlock writer, false if the entry stays locked
+        bool enter(Entry &e, uint32_t &s) {
+            s = e.seq.load(std::memory_order_relaxed);
+            for (int spins = 0; spins < MAX_SPINS; spins++) {
+                if (0 == (s & 1)) {
+                    if (!e.seq.compare_exchange_weak(s, s + 1, std::memory_order_acq_rel)) continue;
+                    e.writer.store(getpid(), std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_release);
+                    return true;
+                }
+                if (spins > SEQ_SPIN) {
+                    recover(e, s);
+                    sched_yield();
+                }
+                if (interrupted) return false;
+                s = e.seq.load(std::memory_order_relaxed);
+            }
+            return false;
+        }
+
+        // Clears the writer first: a locked entry without one is never taken over
+        void leave(Entry &e, uint32_t s) {
+            e.writer.store(0, std::memory_order_relaxed);
+            e.seq.store(s + 2, std::memory_order_release);
+        }
+
+        // Drops an entry whose writer died while holding it at odd sequence `s`
+        void recover(Entry &e, uint32_t s) {
+            int32_t w = e.writer.load(std::memory_order_relaxed);
+            if (w <= 0 || w == getpid() || 0 == kill(w, 0) || ESRCH != errno) return;
+            // One process takes over, the others see a writer that is alive
+            if (!e.writer.compare_exchange_strong(w, getpid(), std::memory_order_acq_rel)) return;
+            if (e.seq.load(std::memory_order_acquire) != s) return;
+            e.meta.kind = removed;
+            e.attached.store(0, std::memory_order_relaxed);
+            leave(e, s - 1);
+        }
+
+        static Info info(const Meta &m, Entry &e) {
+            return Info{std::string(m.name, strnlen(m.name, NAME_SIZE)), (Kind) m.kind, m.msg_size, m.msg_count,
+                        m.pid, m.created_ns, e.attached.load(std::memory_order_relaxed)};
+        }
+
+        Entry *lookup(const std::string &name, Info &i) {
+            Meta m;
+            ui h = hash(name);
+            for (ui k = 0; k < CAPACITY; k++) {
+                Entry &e = entries[(h + k) % CAPACITY];
+                if (!snapshot(e, m)) continue;
+                if (empty == m.kind) return nullptr;
+                if (live(m, name)) {
+                    i = info(m, e);
+                    return &e;
+                }
+            }
+            return nullptr;
+        }
+
+        Shm mem;
+        Entry *entries = nullptr;
+    };
 
 }
 
@@ -371,6 +874,7 @@ public:
         return loc;
     }
     static bool remove(const std::string &name){
+        tpc::Registry::on_remove(name);
         auto b = Box(name, 0);
         return b.remove();
     }
@@ -385,6 +889,23 @@ public:
     bool get(void* data){
         return get(data, mysize);
     }
+    // Like get(), but gives up after `timeout_us` microseconds. A value that is already being
+    // put when the time runs out is still returned.
+    bool get(void* data, ui size, long timeout_us){
+        if (tpc::interrupted) return false;
+        if (size > this->mysize) return false;
+        struct timespec at = tpc::wall_deadline(timeout_us);
+        sem_post(w_sem->sem);
+        while (0 != sem_timedwait(r_sem->sem, &at)) {
+            if (EINTR == errno && !tpc::interrupted) continue;
+            // Take back the permission to put, unless a writer has already used it
+            if (0 == sem_trywait(w_sem->sem)) return false;
+            sem_wait(r_sem->sem);
+            break;
+        }
+        memcpy(data, mem->data, size);
+        return true;
+    }
     bool put(void* data, ui size){
         if (tpc::interrupted) return false;
         if (size > this->mysize) return false;
@@ -396,6 +917,53 @@ public:
     bool put(void* data){
         return put(data, mysize);
     }
+    // Like put(), but gives up if no reader comes within `timeout_us` microseconds
+    bool put(void* data, ui size, long timeout_us){
+        if (tpc::interrupted) return false;
+        if (size > this->mysize) return false;
+        struct timespec at = tpc::wall_deadline(timeout_us);
+        while (0 != sem_timedwait(w_sem->sem, &at))
+            if (EINTR != errno || tpc::interrupted) return false;
+        memcpy(mem->data, data, size);
+        sem_post(r_sem->sem);
+        return true;
+    }
+    // Non-blocking halves of put()/get() for event loops. A reader offer()s to take a value, polls
+    // can_get() and takes it with try_get(), or withdraw()s the offer; a writer polls can_put()
+    // and hands the value over with try_put().
+    bool can_put(){
+        int v = 0;
+        sem_getvalue(w_sem->sem, &v);
+        return v > 0;
+    }
+    bool try_put(void* data, ui size){
+        if (size > this->mysize) return false;
+        if (0 != sem_trywait(w_sem->sem)) return false;
+        memcpy(mem->data, data, size);
+        sem_post(r_sem->sem);
+        return true;
+    }
+    void offer(){
+        sem_post(w_sem->sem);
+    }
+    bool can_get(){
+        int v = 0;
+        sem_getvalue(r_sem->sem, &v);
+        return v > 0;
+    }
+    bool try_get(void* data, ui size){
+        if (size > this->mysize) return false;
+        if (0 != sem_trywait(r_sem->sem)) return false;
+        memcpy(data, mem->data, size);
+        return true;
+    }
+    // Takes back an offer; a value that is already being put is dropped
+    void withdraw(){
+        if (0 != sem_trywait(w_sem->sem)) sem_wait(r_sem->sem);
+    }
+    ui get_size(){
+        return mysize;
+    }
     bool remove(){
         return r_sem->remove() && w_sem->remove() && mem->remove();
     }
@@ -414,36 +982,481 @@ private:
         return r_sem->exists() && w_sem->exists() && mem -> exists();
     }
     bool create(){
-        return r_sem->create(0) && w_sem->create(0) && mem->create();
+        if (!(r_sem->create(0) && w_sem->create(0) && mem->create())) return false;
+        tpc::Registry::on_create(name, tpc::Registry::box, mysize, 1);
+        return true;
     }
     bool open(){
-        return r_sem->open() && w_sem->open() && mem->open(false);
+        if (!(r_sem->open() && w_sem->open() && mem->open(false))) return false;
+        registration = tpc::Registry::on_open(name);
+        return true;
     }
     std::string name;
     ui mysize;
     tpc::Shm mem;
     tpc::Sem r_sem, w_sem;
+    tpc::Registry::Attach registration;
+};
+
+
+// Single-producer/single-consumer Box with `depth` slots (rounded up to a power of two):
+// put() only blocks when the ring is full and get() only when it is empty.
+class BufferedBox{
+public:
+    using Ptr=std::shared_ptr<BufferedBox>;
+    static Ptr create(const std::string &name, ui size, ui depth){
+        if (!valid(size, depth)) return nullptr;
+        Ptr loc(new BufferedBox(name, size, depth));
+        if (loc->mem->exists()) return nullptr;
+        loc->mem->remove();
+        if (!loc->mem->create() || !loc->open()) return nullptr;
+        return loc;
+    }
+    static Ptr just_open(const std::string &name, ui size, ui depth){
+        if (!valid(size, depth)) return nullptr;
+        Ptr loc(new BufferedBox(name, size, depth));
+        if (!loc->mem->exists()) return nullptr;
+        if (!loc->open()) return nullptr;
+        return loc;
+    }
+    static Ptr open_create(const std::string &name, ui size, ui depth){
+        if (!valid(size, depth)) return nullptr;
+        Ptr loc(new BufferedBox(name, size, depth));
+        if (!loc->mem->exists()) {
+            loc->mem->remove();
+            if (!loc->mem->create()) return nullptr;
+        }
+        if (!loc->open()) return nullptr;
+        return loc;
+    }
+    static bool remove(const std::string &name){
+        return tpc::SharedMemory(name, 0).remove();
+    }
+    bool get(void* data, ui size){
+        if (tpc::interrupted) return false;
+        if (size > this->mysize) return false;
+        uint32_t h = hdr->head.load(std::memory_order_relaxed);
+        while (h == cached_tail && h == (cached_tail = hdr->tail.load(std::memory_order_acquire))) {
+            if (!sleep(&hdr->tail, &hdr->get_waits, h)) return false;
+        }
+        memcpy(data, slot(h) + UI_SZ, size);
+        hdr->head.store(h + 1, std::memory_order_seq_cst);
+        if (hdr->put_waits.load(std::memory_order_seq_cst)) tpc::futex_wake(&hdr->head);
+        return true;
+    }
+    bool get(void* data){
+        return get(data, mysize);
+    }
+    bool try_get(void* data, ui size){
+        if (size > this->mysize) return false;
+        uint32_t h = hdr->head.load(std::memory_order_relaxed);
+        if (h == cached_tail && h == (cached_tail = hdr->tail.load(std::memory_order_acquire))) return false;
+        memcpy(data, slot(h) + UI_SZ, size);
+        hdr->head.store(h + 1, std::memory_order_seq_cst);
+        if (hdr->put_waits.load(std::memory_order_seq_cst)) tpc::futex_wake(&hdr->head);
+        return true;
+    }
+    bool put(void* data, ui size){
+        if (tpc::interrupted) return false;
+        if (size > this->mysize) return false;
+        uint32_t t = hdr->tail.load(std::memory_order_relaxed);
+        while (t - cached_head >= depth && t - (cached_head = hdr->head.load(std::memory_order_acquire)) >= depth) {
+            if (!sleep(&hdr->head, &hdr->put_waits, cached_head)) return false;
+        }
+        write(t, data, size);
+        return true;
+    }
+    bool put(void* data){
+        return put(data, mysize);
+    }
+    bool try_put(void* data, ui size){
+        if (size > this->mysize) return false;
+        uint32_t t = hdr->tail.load(std::memory_order_relaxed);
+        if (t - cached_head >= depth && t - (cached_head = hdr->head.load(std::memory_order_acquire)) >= depth)
+            return false;
+        write(t, data, size);
+        return true;
+    }
+    // Count of messages currently buffered
+    ui count(){
+        return hdr->tail.load(std::memory_order_acquire) - hdr->head.load(std::memory_order_acquire);
+    }
+    ui get_depth(){
+        return depth;
+    }
+    bool remove(){
+        return mem->remove();
+    }
+    const std::string & get_name(){
+        return name;
+    }
+
+    // Cursors are free-running 32-bit counters (slot = cursor % depth), each on its own cache line
+    // together with the waiters count of the opposite side, which is only polled by the cursor owner.
+    struct Header {
+        alignas(64) std::atomic<uint32_t> head;
+        std::atomic<uint32_t> put_waits;
+        alignas(64) std::atomic<uint32_t> tail;
+        std::atomic<uint32_t> get_waits;
+        alignas(64) ui msg_size;
+        ui depth;
+    };
+private:
+    static const ui UI_SZ = sizeof(ui);
+    static const int SPIN = 1000;
+    static bool valid(ui size, ui depth){
+        return size > 0 && depth > 0 && depth < (1ul << 31);
+    }
+    BufferedBox(const std::string& name, ui size, ui depth){
+        this->name = name;
+        this->mysize = size;
+        this->depth = 1;
+        while (this->depth < depth) this->depth <<= 1;
+        stride = (UI_SZ + size + 7) & ~(ui) 7;
+        mem = tpc::ShmMake(name, sizeof(Header) + stride * this->depth);
+    }
+    bool open(){
+        if (!mem->open(false)) return false;
+        hdr = (Header *) mem->data;
+        hdr->msg_size = mysize;
+        hdr->depth = depth;
+        cached_head = hdr->head.load();
+        cached_tail = hdr->tail.load();
+        return true;
+    }
+    char *slot(uint32_t cursor){
+        return (char *) mem->data + sizeof(Header) + (cursor % depth) * stride;
+    }
+    void write(uint32_t t, void *data, ui size){
+        char *s = slot(t);
+        *(ui *) s = size;
+        memcpy(s + UI_SZ, data, size);
+        hdr->tail.store(t + 1, std::memory_order_seq_cst);
+        if (hdr->get_waits.load(std::memory_order_seq_cst)) tpc::futex_wake(&hdr->tail);
+    }
+    // Spins briefly, then announces a waiter on `word` and sleeps until it moves away from `seen`
+    bool sleep(std::atomic<uint32_t> *word, std::atomic<uint32_t> *waits, uint32_t seen){
+        for (int i = 0; i < SPIN; i++)
+            if (word->load(std::memory_order_acquire) != seen) return true;
+        waits->fetch_add(1, std::memory_order_seq_cst);
+        if (word->load(std::memory_order_seq_cst) == seen) tpc::futex_wait(word, seen);
+        waits->fetch_sub(1, std::memory_order_seq_cst);
+        return !tpc::interrupted;
+    }
+    std::string name;
+    ui mysize, depth, stride;
+    uint32_t cached_head, cached_tail;
+    Header *hdr;
+    tpc::Shm mem;
+};
+
+
+namespace tpc {
+    // Lock-free bounded multi-producer/multi-consumer ring over memory owned by the caller
+    // (a WorkQueue segment, a slot of a service response pool). Every slot carries a sequence
+    // number, so producers and consumers claim slots with a single CAS on the tail/head cursor.
+    // Slot layout: [seq][size][data]. seq is stored relative to the slot index, so zero-filled
+    // memory is a valid empty ring and needs no initialization.
+    class MPMCRing {
+    public:
+        struct Header {
+            alignas(64) std::atomic<ui> tail;
+            alignas(64) std::atomic<ui> head;
+            alignas(64) std::atomic<uint32_t> items_ev;
+            std::atomic<uint32_t> get_waiters;
+            alignas(64) std::atomic<uint32_t> space_ev;
+            std::atomic<uint32_t> put_waiters;
+        };
+
+        static ui round_depth(ui depth) {
+            ui d = 1;
+            while (d < depth) d <<= 1;
+            return d;
+        }
+        static ui stride_of(ui size) {
+            return (UI_SZ * 2 + size + 7) & ~(ui) 7;
+        }
+        // Bytes of slots for `depth` (already rounded) messages of `size` bytes
+        static ui slots_size(ui size, ui depth) {
+            return stride_of(size) * depth;
+        }
+
+        void attach(Header *hdr, char *slots, ui size, ui depth) {
+            this->hdr = hdr;
+            this->slots = slots;
+            this->mysize = size;
+            this->depth = depth;
+            this->stride = stride_of(size);
+        }
+        bool put(const void* data, ui size, Deadline deadline = Deadline()){
+            if (size > mysize) return false;
+            while (!try_put(data, size)) {
+                if (!sleep(&hdr->space_ev, &hdr->put_waiters, [this]() { return !full(); }, deadline)) return false;
+            }
+            return true;
+        }
+        bool try_put(const void* data, ui size){
+            if (interrupted || size > mysize) return false;
+            ui pos = hdr->tail.load(std::memory_order_relaxed);
+            while (true) {
+                char *s = slot(pos);
+                ui seq = seq_of(s, pos);
+                if (seq == pos) {
+                    if (hdr->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                } else if (seq < pos) return false;
+                else pos = hdr->tail.load(std::memory_order_relaxed);
+            }
+            char *s = slot(pos);
+            *(ui *) (s + UI_SZ) = size;
+            memcpy(s + UI_SZ * 2, data, size);
+            set_seq(s, pos, pos + 1);
+            if (hdr->get_waiters.load(std::memory_order_seq_cst)) {
+                hdr->items_ev.fetch_add(1, std::memory_order_seq_cst);
+                futex_wake(&hdr->items_ev, 1);
+            }
+            return true;
+        }
+        ui get_batch(void* data, ui size, ui max, ui *sizes, Deadline deadline = Deadline()){
+            if (size > mysize) return 0;
+            ui n;
+            while (0 == (n = try_get_batch(data, size, max, sizes))) {
+                if (!sleep(&hdr->items_ev, &hdr->get_waiters, [this]() { return !empty(); }, deadline)) return 0;
+            }
+            return n;
+        }
+        ui try_get_batch(void* data, ui size, ui max, ui *sizes){
+            if (interrupted || size > mysize || 0 == max) return 0;
+            if (max > depth) max = depth;
+            ui pos = hdr->head.load(std::memory_order_relaxed);
+            ui n;
+            while (true) {
+                n = 0;
+                while (n < max && seq_of(slot(pos + n), pos + n) == pos + n + 1) n++;
+                if (0 == n) {
+                    if (seq_of(slot(pos), pos) < pos + 1) return 0;
+                    pos = hdr->head.load(std::memory_order_relaxed);
+                    continue;
+                }
+                if (hdr->head.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) break;
+            }
+            for (ui i = 0; i < n; i++) {
+                char *s = slot(pos + i);
+                if (sizes) sizes[i] = *(ui *) (s + UI_SZ);
+                memcpy((char *) data + i * size, s + UI_SZ * 2, size);
+                set_seq(s, pos + i, pos + i + depth);
+            }
+            if (hdr->put_waiters.load(std::memory_order_seq_cst)) {
+                hdr->space_ev.fetch_add(1, std::memory_order_seq_cst);
+                futex_wake(&hdr->space_ev, (int) n);
+            }
+            return n;
+        }
+        // Approximate count of queued messages
+        ui count(){
+            ui t = hdr->tail.load(std::memory_order_acquire), h = hdr->head.load(std::memory_order_acquire);
+            return t > h ? t - h : 0;
+        }
+        ui get_depth(){
+            return depth;
+        }
+    private:
+        static const ui UI_SZ = sizeof(ui);
+        char *slot(ui cursor){
+            return slots + (cursor & (depth - 1)) * stride;
+        }
+        ui seq_of(char *s, ui cursor){
+            return ((std::atomic<ui> *) s)->load(std::memory_order_acquire) + (cursor & (depth - 1));
+        }
+        void set_seq(char *s, ui cursor, ui seq){
+            ((std::atomic<ui> *) s)->store(seq - (cursor & (depth - 1)), std::memory_order_seq_cst);
+        }
+        bool full(){
+            ui pos = hdr->tail.load(std::memory_order_seq_cst);
+            return seq_of(slot(pos), pos) < pos;
+        }
+        bool empty(){
+            ui pos = hdr->head.load(std::memory_order_seq_cst);
+            return seq_of(slot(pos), pos) < pos + 1;
+        }
+        template<typename F>
+        bool sleep(std::atomic<uint32_t> *ev, std::atomic<uint32_t> *waiters, F ready, Deadline &deadline){
+            const struct timespec *left;
+            if (interrupted || !deadline.left(left)) return false;
+            waiters->fetch_add(1, std::memory_order_seq_cst);
+            uint32_t seen = ev->load(std::memory_order_seq_cst);
+            if (!ready()) futex_wait(ev, seen, left);
+            waiters->fetch_sub(1, std::memory_order_seq_cst);
+            return !interrupted;
+        }
+        Header *hdr = nullptr;
+        char *slots = nullptr;
+        ui mysize = 0, depth = 0, stride = 0;
+    };
+}
+
+
+// Bounded multi-producer/multi-consumer Box with `depth` slots (rounded up to a power of two).
+// Producers and consumers claim slots with a single CAS on the tail/head cursor and never
+// serialize on a lock (see tpc::MPMCRing). get_batch() claims several consecutive ready
+// messages at once.
+class WorkQueue{
+public:
+    using Ptr=std::shared_ptr<WorkQueue>;
+    static Ptr create(const std::string &name, ui size, ui depth){
+        if (size == 0 || depth == 0) return nullptr;
+        Ptr loc(new WorkQueue(name, size, depth));
+        if (loc->mem->exists()) return nullptr;
+        loc->mem->remove();
+        if (!loc->mem->create() || !loc->open()) return nullptr;
+        return loc;
+    }
+    static Ptr just_open(const std::string &name, ui size, ui depth){
+        if (size == 0 || depth == 0) return nullptr;
+        Ptr loc(new WorkQueue(name, size, depth));
+        if (!loc->mem->exists()) return nullptr;
+        if (!loc->open()) return nullptr;
+        return loc;
+    }
+    // Opens existing queue with whatever depth it was created with
+    static Ptr just_open(const std::string &name, ui size){
+        if (size == 0) return nullptr;
+        Ptr loc(new WorkQueue(name, size, 1));
+        if (!loc->mem->exists()) return nullptr;
+        if (!loc->open(true)) return nullptr;
+        return loc;
+    }
+    static Ptr open_create(const std::string &name, ui size, ui depth){
+        if (size == 0 || depth == 0) return nullptr;
+        Ptr loc(new WorkQueue(name, size, depth));
+        if (!loc->mem->exists()) {
+            loc->mem->remove();
+            if (!loc->mem->create()) return nullptr;
+        }
+        if (!loc->open()) return nullptr;
+        return loc;
+    }
+    static bool remove(const std::string &name){
+        return tpc::SharedMemory(name, 0).remove();
+    }
+    bool put(void* data, ui size){
+        return ring.put(data, size);
+    }
+    bool put(void* data){
+        return put(data, mysize);
+    }
+    // Like put(), but gives up after `timeout_us` microseconds
+    bool put(void* data, ui size, long timeout_us){
+        return ring.put(data, size, tpc::Deadline(timeout_us));
+    }
+    bool try_put(void* data, ui size){
+        return ring.try_put(data, size);
+    }
+    bool get(void* data, ui size){
+        return get_batch(data, size, 1) == 1;
+    }
+    bool get(void* data){
+        return get(data, mysize);
+    }
+    // Like get(), but gives up after `timeout_us` microseconds
+    bool get(void* data, ui size, long timeout_us){
+        return get_batch(data, size, 1, nullptr, timeout_us) == 1;
+    }
+    bool try_get(void* data, ui size){
+        return try_get_batch(data, size, 1, nullptr) == 1;
+    }
+    // Blocks until at least one message is available (or `timeout_us` passes, if not negative),
+    // then takes up to `max` of them.
+    // Message i is copied to data + i * size, its written size is stored to sizes[i] if given.
+    ui get_batch(void* data, ui size, ui max, ui *sizes = nullptr, long timeout_us = -1){
+        return ring.get_batch(data, size, max, sizes, tpc::Deadline(timeout_us));
+    }
+    ui try_get_batch(void* data, ui size, ui max, ui *sizes = nullptr){
+        return ring.try_get_batch(data, size, max, sizes);
+    }
+    // Approximate count of queued messages
+    ui count(){
+        return ring.count();
+    }
+    ui get_depth(){
+        return depth;
+    }
+    bool remove(){
+        return mem->remove();
+    }
+    const std::string & get_name(){
+        return name;
+    }
+
+    struct Header : tpc::MPMCRing::Header {
+        alignas(64) ui msg_size;
+        ui depth;
+    };
+private:
+    WorkQueue(const std::string& name, ui size, ui depth){
+        this->name = name;
+        this->mysize = size;
+        this->depth = tpc::MPMCRing::round_depth(depth);
+        mem = tpc::ShmMake(name, sizeof(Header) + tpc::MPMCRing::slots_size(size, this->depth));
+    }
+    bool open(bool ign_depth = false){
+        if (!mem->open(ign_depth)) return false;
+        hdr = (Header *) mem->data;
+        if (ign_depth) {
+            depth = hdr->depth;
+            if (hdr->msg_size != mysize || 0 == depth
+                || mem->size != sizeof(Header) + tpc::MPMCRing::slots_size(mysize, depth)) {
+                mem->close();
+                return tpc::Err("WorkQueue " + name + " has other message size");
+            }
+        } else {
+            hdr->msg_size = mysize;
+            hdr->depth = depth;
+        }
+        ring.attach(hdr, (char *) mem->data + sizeof(Header), mysize, depth);
+        return true;
+    }
+    std::string name;
+    ui mysize, depth;
+    Header *hdr;
+    tpc::MPMCRing ring;
+    tpc::Shm mem;
 };
 
 
 class Variable{
 public:
     using Ptr=std::shared_ptr<Variable>;
-    static Ptr create(const std::string &name, ui size){
-        Ptr var(new Variable(name, size));
-        if (var->exists()) return nullptr;
+    // rwlock: readers and writers synchronize on named semaphores (-varR/-varW).
+    // seqlock: writers bump a sequence counter around the copy and readers retry on mismatch,
+    // so readers never write shared memory or enter the kernel. No semaphores are created.
+    // multibuffer: writers fill a spare copy and publish it, readers pin the current copy with
+    // a reference count, so neither side waits for the other. No semaphores are created.
+    // fair_rwlock: writer-preferring readers/writer lock on futexes in the header; a queued writer
+    // stops new readers, so writers are not starved by a steady stream of readers.
+    enum Mode : uint32_t {rwlock = 1, seqlock = 2, multibuffer = 3, fair_rwlock = 4};
+    static bool valid_mode(uint32_t mode){
+        return rwlock <= mode && mode <= fair_rwlock;
+    }
+    static Ptr create(const std::string &name, ui size, Mode mode = rwlock){
+        if (!valid_mode(mode)) return nullptr;
+        Ptr var(new Variable(name, size, mode));
+        if (var->exists() || var->other_mode()) return nullptr;
         var->remove();
         if (!var->create() || !var->open()) return nullptr;
         return var;
     }
-    static Ptr just_open(const std::string &name, ui size){
-        Ptr var(new Variable(name, size));
+    static Ptr just_open(const std::string &name, ui size, Mode mode = rwlock){
+        if (!valid_mode(mode)) return nullptr;
+        Ptr var(new Variable(name, size, mode));
         if (!var->exists()) return nullptr;
         if (!var->open()) return nullptr;
         return var;
     }
-    static Ptr open_create(const std::string &name, ui size){
-        Ptr var(new Variable(name, size));
+    static Ptr open_create(const std::string &name, ui size, Mode mode = rwlock){
+        if (!valid_mode(mode)) return nullptr;
+        Ptr var(new Variable(name, size, mode));
+        // A segment of another mode is a live variable, not leftovers to clean up
+        if (var->other_mode()) return nullptr;
         if (!var->exists()) {
             var->remove();
             if (!var->create()) return nullptr;
@@ -452,64 +1465,663 @@ public:
         return var;
     }
     static bool remove(const std::string &name){
-        auto b = Variable(name, 0);
+        tpc::Registry::on_remove(name);
+        auto b = Variable(name, 0, rwlock);
         return b.remove();
     }
+    // `size` bytes at `offset` of the value <-> `data`
+    struct Range {
+        ui offset;
+        ui size;
+        void *data;
+    };
     bool read(const void *data, ui size){
+        return read_at(data, 0, size);
+    }
+    bool read(const void *data){
+        return read(data, mysize);
+    }
+    bool read_at(const void *data, ui offset, ui size){
+        Range r = {offset, size, (void *) data};
+        return read_ranges(&r, 1);
+    }
+    // Gathers several disjoint ranges under one lock acquisition (one consistent snapshot)
+    bool read_ranges(const Range *ranges, ui count){
         if (tpc::interrupted) return false;
-        if (size > this->mysize) return false;
+        if (!valid(ranges, count)) return false;
+        if (seqlock == mode) return seq_read(ranges, count);
+        if (multibuffer == mode) return mb_read(ranges, count);
+        if (fair_rwlock == mode) {
+            auto l = tpc::FairRWLock(&hdr->rw_state, &hdr->rw_wlock);
+            if (!l.reader_lock()) return false;
+            copy_out(payload, ranges, count);
+            return true;
+        }
         auto l = tpc::RWLock(w_sem->sem, r_sem->sem, counter);
         if (!l.reader_lock()) return false;
-        memcpy((void *)data, mem->data, size);
+        copy_out(payload, ranges, count);
+        return true;
+    }
+    bool write(const void *data, ui size){
+        return write_at(data, 0, size);
+    }
+    bool write(const void *data){
+        return write(data, mysize);
+    }
+    bool write_at(const void *data, ui offset, ui size){
+        Range r = {offset, size, (void *) data};
+        return write_ranges(&r, 1);
+    }
+    // Scatters several disjoint ranges as one write (one version increment).
+    // In multibuffer mode the untouched part of the value is copied from the current buffer.
+    bool write_ranges(const Range *ranges, ui count){
+        if (tpc::interrupted) return false;
+        if (!valid(ranges, count)) return false;
+        if (seqlock == mode) return seq_write(ranges, count);
+        if (multibuffer == mode) return mb_write(ranges, count);
+        if (fair_rwlock == mode) {
+            auto l = tpc::FairRWLock(&hdr->rw_state, &hdr->rw_wlock);
+            if (!l.writer_lock()) return false;
+            copy_in(payload, ranges, count);
+            changed();
+            return true;
+        }
+        auto l = tpc::RWLock(w_sem->sem, r_sem->sem, counter);
+        if (!l.writer_lock()) return false;
+        copy_in(payload, ranges, count);
+        changed();
+        return true;
+    }
+    // Incremented by every write; wraps around, so compare versions for equality only
+    uint32_t version(){
+        return hdr->version.load(std::memory_order_acquire);
+    }
+    // Blocks until the version differs from `last_version` and returns the new one.
+    // Returns `last_version` if `timeout_us` (negative means forever) expired or the thread was interrupted.
+    uint32_t wait_changed(uint32_t last_version, long timeout_us = -1){
+        uint32_t v = version();
+        if (v != last_version) return v;
+        tpc::Deadline deadline(timeout_us);
+        const struct timespec *left;
+        while (v == last_version && !tpc::interrupted) {
+            if (!deadline.left(left)) break;
+            hdr->version_waiters.fetch_add(1, std::memory_order_seq_cst);
+            if (hdr->version.load(std::memory_order_seq_cst) == last_version)
+                tpc::futex_wait(&hdr->version, last_version, left);
+            hdr->version_waiters.fetch_sub(1, std::memory_order_seq_cst);
+            v = version();
+        }
+        return v;
+    }
+    bool remove(){
+        return r_sem->remove() && w_sem->remove() && mem->remove();
+    }
+    const std::string & get_name(){
+        return name;
+    }
+    Mode get_mode(){
+        return mode;
+    }
+
+    static const ui MAX_DIMS = 8;
+    // Describes the value as a C-contiguous array for zero-copy consumers (e.g. numpy through
+    // the Python module). `format` is a struct module / PEP 3118 item format like "d" or "<i".
+    struct Layout {
+        char format[16];
+        ui itemsize;
+        ui ndim;
+        ui shape[MAX_DIMS];
+    };
+    bool set_layout(const char *format, ui itemsize, const ui *shape, ui ndim){
+        if (0 == itemsize || 0 == ndim || ndim > MAX_DIMS || strlen(format) >= sizeof(Layout::format)) return false;
+        ui items = 1;
+        for (ui i = 0; i < ndim; i++) {
+            if (0 != shape[i] && items > mysize / shape[i]) return false;
+            items *= shape[i];
+        }
+        if (items > mysize / itemsize) return false;
+        Layout l = {};
+        strcpy(l.format, format);
+        l.itemsize = itemsize;
+        l.ndim = ndim;
+        memcpy(l.shape, shape, ndim * sizeof(ui));
+        uint32_t s;
+        if (!tpc::seq_writer_enter(&meta->seq, &meta->waiters, s)) return false;
+        meta->layout = l;
+        tpc::seq_writer_leave(&meta->seq, &meta->waiters, s);
+        return true;
+    }
+    // False if no layout was set
+    bool get_layout(Layout &layout){
+        if (!tpc::seq_read(&meta->seq, [&]() { layout = meta->layout; })) return false;
+        return 0 != layout.itemsize;
+    }
+
+    // Zero-copy access: between enter_read()/enter_write() and leave() `data` points at the value
+    // in shared memory. Lock modes hold the lock for the whole section. Seqlock read sections
+    // don't lock, so leave() returns false if a writer changed the value meanwhile and whatever
+    // was read must be discarded. Multibuffer read sections pin the current copy, write sections
+    // fill a spare copy with the current value and publish it on leave().
+    class Section {
+    public:
+        char *data = nullptr;
+        bool writable = false;
+        ~Section(){
+            if (nullptr != var) var->leave(*this);
+        }
+    private:
+        friend class Variable;
+        Variable *var = nullptr;
+        uint32_t seq = 0;
+        ui cur = 0, idx = 0;
+        std::unique_ptr<tpc::RWLock> rw;
+        std::unique_ptr<tpc::FairRWLock> fair;
+    };
+    bool enter_read(Section &s){
+        if (tpc::interrupted || nullptr != s.var) return false;
+        if (seqlock == mode) {
+            for (int spins = 0; 1 & (s.seq = hdr->seq.load(std::memory_order_acquire)); spins++) {
+                if (tpc::interrupted) return false;
+                if (spins > SPIN) sched_yield();
+            }
+            s.data = payload;
+        } else if (multibuffer == mode) {
+            if (!mb_pin(s.idx)) return false;
+            s.data = buffer(s.idx);
+        } else if (fair_rwlock == mode) {
+            s.fair.reset(new tpc::FairRWLock(&hdr->rw_state, &hdr->rw_wlock));
+            if (!s.fair->reader_lock()) { s.fair.reset(); return false; }
+            s.data = payload;
+        } else {
+            s.rw.reset(new tpc::RWLock(w_sem->sem, r_sem->sem, counter));
+            if (!s.rw->reader_lock()) { s.rw.reset(); return false; }
+            s.data = payload;
+        }
+        s.var = this;
+        s.writable = false;
+        return true;
+    }
+    bool enter_write(Section &s){
+        if (tpc::interrupted || nullptr != s.var) return false;
+        if (seqlock == mode) {
+            if (!writer_enter(s.seq)) return false;
+            s.data = payload;
+        } else if (multibuffer == mode) {
+            if (!writer_enter(s.seq)) return false;
+            s.cur = hdr->current.load(std::memory_order_seq_cst);
+            s.idx = mb_spare(s.cur);
+            memcpy(buffer(s.idx), buffer(s.cur & 0xff), mysize);
+            s.data = buffer(s.idx);
+        } else if (fair_rwlock == mode) {
+            s.fair.reset(new tpc::FairRWLock(&hdr->rw_state, &hdr->rw_wlock));
+            if (!s.fair->writer_lock()) { s.fair.reset(); return false; }
+            s.data = payload;
+        } else {
+            s.rw.reset(new tpc::RWLock(w_sem->sem, r_sem->sem, counter));
+            if (!s.rw->writer_lock()) { s.rw.reset(); return false; }
+            s.data = payload;
+        }
+        s.var = this;
+        s.writable = true;
+        return true;
+    }
+    // False only for a seqlock read section that raced with a writer
+    bool leave(Section &s){
+        if (this != s.var) return false;
+        bool consistent = true;
+        if (seqlock == mode) {
+            if (s.writable) writer_leave(s.seq);
+            else {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                consistent = hdr->seq.load(std::memory_order_relaxed) == s.seq;
+            }
+        } else if (multibuffer == mode) {
+            if (s.writable) {
+                mb_publish(s.cur, s.idx);
+                writer_leave(s.seq);
+            } else hdr->refs[s.idx].fetch_sub(1, std::memory_order_release);
+        } else {
+            if (s.writable) changed();
+            s.rw.reset();
+            s.fair.reset();
+        }
+        s.var = nullptr;
+        s.data = nullptr;
+        return consistent;
+    }
+
+    static const ui MB_BUFFERS = 4;
+    // Occupies the first cache line of the segment, then come Meta and the value (or MB_BUFFERS copies of it).
+    struct Header {
+        ui counter;
+        std::atomic<uint32_t> mode;
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> seq_waiters;
+        std::atomic<ui> current;                // multibuffer: version << 8 | buffer index
+        std::atomic<uint32_t> refs[MB_BUFFERS]; // multibuffer: readers pinning each buffer
+        std::atomic<uint32_t> version;
+        std::atomic<uint32_t> version_waiters;
+        std::atomic<uint32_t> rw_state;         // fair_rwlock
+        std::atomic<uint32_t> rw_wlock;         // fair_rwlock
+    };
+    // Follows the header, guarded by its own seqlock
+    struct Meta {
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> waiters;
+        Layout layout;
+    };
+    static const ui META_START = 64;
+    static const ui DATA_START = 192;
+private:
+    static const int SPIN = 100;
+    Variable(const std::string& name, ui size, Mode mode){
+        this->name = name;
+        this->mysize = size;
+        this->mode = mode;
+        r_sem = tpc::SemMake(name + "-varR");
+        w_sem = tpc::SemMake(name + "-varW");
+        static_assert(sizeof(Header) <= META_START, "Variable header doesn't fit its cache line");
+        static_assert(META_START + sizeof(Meta) <= DATA_START, "Variable layout doesn't fit before the value");
+        mem = tpc::ShmMake(name, DATA_START + size * (multibuffer == mode ? MB_BUFFERS : 1));
+    }
+    bool exists(){
+        if (rwlock != mode) return mem->exists();
+        return r_sem->exists() && w_sem->exists() && mem -> exists();
+    }
+    // Whether the segment exists and is stamped with a mode other than ours
+    bool other_mode(){
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        uint32_t found = 0;
+        struct stat info;
+        if (0 == fstat(fd, &info) && (ui) info.st_size >= sizeof(Header)) {
+            void *p = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+            if (MAP_FAILED != p) {
+                found = ((Header *) p)->mode.load(std::memory_order_acquire);
+                munmap(p, sizeof(Header));
+            }
+        }
+        ::close(fd);
+        if (0 == found || found == mode) return false;
+        return !tpc::Err("Variable " + name + " exists with another mode");
+    }
+    bool create(){
+        if (rwlock == mode && !(r_sem->create(1) && w_sem->create(1))) return false;
+        if (!mem->create()) return false;
+        tpc::Registry::on_create(name, tpc::Registry::variable, mysize, 1);
+        return true;
+    }
+    bool open(){
+        if (rwlock == mode && !(r_sem->open() && w_sem->open())) return false;
+        if (!mem->open(false)) return false;
+        hdr = (Header *) mem->data;
+        counter = &hdr->counter;
+        meta = (Meta *) (META_START + (char *) mem->data);
+        payload = DATA_START + (char *) mem->data;
+        // The first opener stamps the mode, later ones must agree with it
+        uint32_t found = 0;
+        if (!hdr->mode.compare_exchange_strong(found, mode) && found != mode)
+            return tpc::Err("Variable " + name + " exists with another mode");
+        registration = tpc::Registry::on_open(name);
+        return true;
+    }
+    bool valid(const Range *ranges, ui count){
+        for (ui i = 0; i < count; i++)
+            if (ranges[i].offset > mysize || ranges[i].size > mysize - ranges[i].offset) return false;
+        return true;
+    }
+    static void copy_out(const char *src, const Range *ranges, ui count){
+        for (ui i = 0; i < count; i++) memcpy(ranges[i].data, src + ranges[i].offset, ranges[i].size);
+    }
+    static void copy_in(char *dst, const Range *ranges, ui count){
+        for (ui i = 0; i < count; i++) memcpy(dst + ranges[i].offset, ranges[i].data, ranges[i].size);
+    }
+    bool seq_read(const Range *ranges, ui count){
+        return tpc::seq_read(&hdr->seq, [&]() { copy_out(payload, ranges, count); });
+    }
+    bool seq_write(const Range *ranges, ui count){
+        uint32_t s;
+        if (!writer_enter(s)) return false;
+        copy_in(payload, ranges, count);
+        writer_leave(s);
+        return true;
+    }
+    // Makes the sequence odd, excluding other seqlock/multibuffer writers
+    bool writer_enter(uint32_t &s){
+        return tpc::seq_writer_enter(&hdr->seq, &hdr->seq_waiters, s);
+    }
+    void writer_leave(uint32_t s){
+        changed();
+        tpc::seq_writer_leave(&hdr->seq, &hdr->seq_waiters, s);
+    }
+    void changed(){
+        hdr->version.fetch_add(1, std::memory_order_seq_cst);
+        if (hdr->version_waiters.load(std::memory_order_seq_cst)) tpc::futex_wake(&hdr->version);
+    }
+    char *buffer(ui idx){
+        return payload + idx * mysize;
+    }
+    // Pins the current buffer against reuse by writers
+    bool mb_pin(ui &idx){
+        while (true) {
+            ui cur = hdr->current.load(std::memory_order_seq_cst);
+            idx = cur & 0xff;
+            hdr->refs[idx].fetch_add(1, std::memory_order_seq_cst);
+            if (hdr->current.load(std::memory_order_seq_cst) == cur) return true;
+            hdr->refs[idx].fetch_sub(1, std::memory_order_relaxed);
+            if (tpc::interrupted) return false;
+        }
+    }
+    bool mb_read(const Range *ranges, ui count){
+        ui idx;
+        if (!mb_pin(idx)) return false;
+        copy_out(buffer(idx), ranges, count);
+        hdr->refs[idx].fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+    // A buffer other than the current one that no reader pins; called by the seqlock owner
+    ui mb_spare(ui cur){
+        ui spare = MB_BUFFERS;
+        for (int spins = 0; MB_BUFFERS == spare; spins++) {
+            for (ui i = 0; i < MB_BUFFERS; i++)
+                if (i != (cur & 0xff) && 0 == hdr->refs[i].load(std::memory_order_seq_cst)) { spare = i; break; }
+            if (spins > SPIN) sched_yield();
+        }
+        return spare;
+    }
+    void mb_publish(ui cur, ui spare){
+        hdr->current.store((((cur >> 8) + 1) << 8) | spare, std::memory_order_seq_cst);
+    }
+    bool mb_write(const Range *ranges, ui count){
+        uint32_t s;
+        if (!writer_enter(s)) return false;
+        ui cur = hdr->current.load(std::memory_order_seq_cst);
+        ui spare = mb_spare(cur);
+        char *dst = buffer(spare), *src = buffer(cur & 0xff);
+        if (1 == count && 0 == ranges[0].offset) {
+            memcpy(dst, ranges[0].data, ranges[0].size);
+            memcpy(dst + ranges[0].size, src + ranges[0].size, mysize - ranges[0].size);
+        } else {
+            memcpy(dst, src, mysize);
+            copy_in(dst, ranges, count);
+        }
+        mb_publish(cur, spare);
+        writer_leave(s);
+        return true;
+    }
+    ui mysize;
+    ui *counter;
+    Mode mode;
+    Header *hdr;
+    Meta *meta;
+    char *payload;
+    std::string name;
+    tpc::Shm mem;
+    tpc::Sem r_sem, w_sem;
+    tpc::Registry::Attach registration;
+};
+
+
+// Variable of a small trivially copyable type kept as a process-shared std::atomic<T>.
+// Only the shared memory segment is created, every operation is a single lock-free instruction.
+template<typename T>
+class AtomicVariable{
+    static_assert(sizeof(T) <= sizeof(ui), "AtomicVariable supports types up to 8 bytes");
+public:
+    using Ptr=std::shared_ptr<AtomicVariable<T>>;
+    static Ptr create(const std::string &name){
+        Ptr var(new AtomicVariable<T>(name));
+        if (var->mem->exists()) return nullptr;
+        var->mem->remove();
+        if (!var->mem->create() || !var->open()) return nullptr;
+        return var;
+    }
+    static Ptr just_open(const std::string &name){
+        Ptr var(new AtomicVariable<T>(name));
+        if (!var->mem->exists()) return nullptr;
+        if (!var->open()) return nullptr;
+        return var;
+    }
+    static Ptr open_create(const std::string &name){
+        Ptr var(new AtomicVariable<T>(name));
+        if (!var->mem->exists()) {
+            var->mem->remove();
+            if (!var->mem->create()) return nullptr;
+        }
+        if (!var->open()) return nullptr;
+        return var;
+    }
+    static bool remove(const std::string &name){
+        return tpc::SharedMemory(name, 0).remove();
+    }
+    T load(){
+        return value->load(std::memory_order_acquire);
+    }
+    void store(T v){
+        value->store(v, std::memory_order_release);
+    }
+    T exchange(T v){
+        return value->exchange(v, std::memory_order_acq_rel);
+    }
+    // On failure `expected` receives the current value
+    bool compare_exchange(T &expected, T desired){
+        return value->compare_exchange_strong(expected, desired, std::memory_order_acq_rel);
+    }
+    T fetch_add(T delta){
+        return value->fetch_add(delta, std::memory_order_acq_rel);
+    }
+    T fetch_sub(T delta){
+        return value->fetch_sub(delta, std::memory_order_acq_rel);
+    }
+    bool remove(){
+        return mem->remove();
+    }
+    const std::string & get_name(){
+        return name;
+    }
+private:
+    explicit AtomicVariable(const std::string &name){
+        this->name = name;
+        mem = tpc::ShmMake(name, sizeof(std::atomic<T>));
+    }
+    bool open(){
+        if (!mem->open(false)) return false;
+        value = (std::atomic<T> *) mem->data;
+        if (!value->is_lock_free()) return tpc::Err("AtomicVariable " + name + " isn't lock-free for this type");
+        return true;
+    }
+    std::string name;
+    std::atomic<T> *value;
+    tpc::Shm mem;
+};
+
+// Many named values in one shared memory segment: an open-addressed hash table of entries
+// plus a data arena. Every entry is guarded by its own seqlock, lookups are lock-free, only
+// adding a new entry takes the table mutex. Entries are never removed, only the whole table.
+class VariableTable{
+public:
+    using Ptr=std::shared_ptr<VariableTable>;
+    using Handle=ui;
+    static const Handle INVALID = ~(ui) 0;
+    static const ui NAME_LEN = 96;
+
+    static Ptr create(const std::string &name, ui capacity, ui arena_size){
+        Ptr tab(new VariableTable(name, capacity, arena_size));
+        if (tab->mem->exists()) return nullptr;
+        tab->mem->remove();
+        if (!tab->mem->create() || !tab->open(true)) return nullptr;
+        return tab;
+    }
+    // Opens existing table with whatever capacity it was created with
+    static Ptr just_open(const std::string &name){
+        Ptr tab(new VariableTable(name, 0, 0));
+        if (!tab->mem->exists()) return nullptr;
+        if (!tab->open(false)) return nullptr;
+        return tab;
+    }
+    static Ptr open_create(const std::string &name, ui capacity, ui arena_size){
+        Ptr tab(new VariableTable(name, capacity, arena_size));
+        if (!tab->mem->exists()) {
+            tab->mem->remove();
+            if (tab->mem->create()) return tab->open(true) ? tab : nullptr;
+        }
+        if (!tab->open(false)) return nullptr;
+        return tab;
+    }
+    static bool remove(const std::string &name){
+        return tpc::SharedMemory(name, 0).remove();
+    }
+    // Handle of existing entry or INVALID
+    Handle find(const std::string &key){
+        if (key.size() >= NAME_LEN) return INVALID;
+        uint32_t h = hash(key);
+        for (ui i = 0, pos = h & (capacity - 1); i < capacity; i++, pos = (pos + 1) & (capacity - 1)) {
+            Entry *e = entry(pos);
+            uint32_t state = e->state.load(std::memory_order_acquire);
+            if (EMPTY == state) return INVALID;
+            if (e->hash == h && 0 == strcmp(e->name, key.c_str())) return pos;
+        }
+        return INVALID;
+    }
+    // Handle of entry `key` of `size` bytes, adding it (zero filled) if it doesn't exist.
+    // Returns INVALID if it exists with another size or the table/arena is full.
+    Handle add(const std::string &key, ui size){
+        Handle found = find(key);
+        if (INVALID != found) return entry(found)->size == size ? found : INVALID;
+        if (key.size() >= NAME_LEN || 0 == size) return INVALID;
+        auto l = tpc::FutexLock(&hdr->lock);
+        uint32_t h = hash(key);
+        for (ui i = 0, pos = h & (capacity - 1); i < capacity; i++, pos = (pos + 1) & (capacity - 1)) {
+            Entry *e = entry(pos);
+            if (READY == e->state.load(std::memory_order_acquire)) {
+                if (e->hash == h && 0 == strcmp(e->name, key.c_str()))
+                    return e->size == size ? pos : INVALID;
+                continue;
+            }
+            ui offset = hdr->arena_used;
+            ui need = (size + tpc::CACHE_LINE - 1) & ~(tpc::CACHE_LINE - 1);
+            if (need > arena_size - offset) {
+                DEBUG_MSG("VariableTable " << name << " arena is full", DF2);
+                return INVALID;
+            }
+            hdr->arena_used = offset + need;
+            e->hash = h;
+            e->offset = offset;
+            e->size = size;
+            strcpy(e->name, key.c_str());
+            e->state.store(READY, std::memory_order_release);
+            hdr->count++;
+            return pos;
+        }
+        DEBUG_MSG("VariableTable " << name << " is full", DF2);
+        return INVALID;
+    }
+    bool read(Handle h, void *data, ui size){
+        if (h >= capacity || size > entry(h)->size) return false;
+        Entry *e = entry(h);
+        char *src = value(e);
+        return tpc::seq_read(&e->seq, [&]() { memcpy(data, src, size); });
+    }
+    bool write(Handle h, const void *data, ui size){
+        if (h >= capacity || size > entry(h)->size) return false;
+        Entry *e = entry(h);
+        uint32_t s;
+        if (!tpc::seq_writer_enter(&e->seq, &e->seq_waiters, s)) return false;
+        memcpy(value(e), data, size);
+        tpc::seq_writer_leave(&e->seq, &e->seq_waiters, s);
         return true;
     }
-    bool read(const void *data){
-        return read(data, mysize);
+    bool read(const std::string &key, void *data, ui size){
+        return read(find(key), data, size);
     }
-    bool write(const void *data, ui size){
-        if (tpc::interrupted) return false;
-        if (size > this->mysize) return false;
-        auto l = tpc::RWLock(w_sem->sem, r_sem->sem, counter);
-        if (!l.writer_lock()) return false;
-        memcpy((void *)mem->data, data, size);
-        return true;
+    bool write(const std::string &key, const void *data, ui size){
+        return write(find(key), data, size);
     }
-    bool write(const void *data){
-        return write(data, mysize);
+    // Size of entry's value, 0 for INVALID handle
+    ui size_of(Handle h){
+        return h < capacity ? entry(h)->size : 0;
+    }
+    ui get_count(){
+        return hdr->count;
+    }
+    ui get_capacity(){
+        return capacity;
     }
     bool remove(){
-        return r_sem->remove() && w_sem->remove() && mem->remove();
+        return mem->remove();
     }
     const std::string & get_name(){
         return name;
     }
+
+    struct Header {
+        std::atomic<uint32_t> ready;
+        std::atomic<uint32_t> lock;
+        ui capacity;
+        ui arena_size;
+        ui arena_used;
+        ui count;
+    };
+    struct Entry {
+        std::atomic<uint32_t> state;
+        uint32_t hash;
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> seq_waiters;
+        ui offset;
+        ui size;
+        char name[NAME_LEN];
+    };
+    static const ui DATA_START = 64;
 private:
-    Variable(const std::string& name, ui size){
+    enum : uint32_t {EMPTY = 0, READY = 1};
+    VariableTable(const std::string &name, ui capacity, ui arena_size){
         this->name = name;
-        this->mysize = size;
-        r_sem = tpc::SemMake(name + "-varR");
-        w_sem = tpc::SemMake(name + "-varW");
-        mem = tpc::ShmMake(name, size + sizeof(ui));
+        this->capacity = 1;
+        while (this->capacity < capacity) this->capacity <<= 1;
+        this->arena_size = (arena_size + tpc::CACHE_LINE - 1) & ~(tpc::CACHE_LINE - 1);
+        mem = tpc::ShmMake(name, full_size());
+    }
+    ui full_size(){
+        return DATA_START + capacity * sizeof(Entry) + arena_size;
+    }
+    bool open(bool created){
+        if (!mem->open(!created)) return false;
+        hdr = (Header *) mem->data;
+        if (created) {
+            hdr->capacity = capacity;
+            hdr->arena_size = arena_size;
+            hdr->ready.store(1, std::memory_order_release);
+        } else {
+            for (int spins = 0; 0 == hdr->ready.load(std::memory_order_acquire); spins++) {
+                if (spins > tpc::SEQ_SPIN || tpc::interrupted) return tpc::Err("VariableTable " + name + " isn't initialized");
+                usleep(1000);
+            }
+            capacity = hdr->capacity;
+            arena_size = hdr->arena_size;
+            if (mem->size != full_size()) return tpc::Err("VariableTable " + name + " has broken size");
+        }
+        entries = (char *) mem->data + DATA_START;
+        arena = entries + capacity * sizeof(Entry);
+        return true;
     }
-    bool exists(){
-        return r_sem->exists() && w_sem->exists() && mem -> exists();
+    static uint32_t hash(const std::string &key){
+        uint32_t h = 2166136261u;
+        for (char c : key) h = (h ^ (unsigned char) c) * 16777619u;
+        return h;
     }
-    bool create(){
-        return r_sem->create(1) && w_sem->create(1) && mem->create();
+    Entry *entry(ui pos){
+        return (Entry *) (entries + pos * sizeof(Entry));
     }
-    bool open(){
-        bool res = r_sem->open() && w_sem->open() && mem->open(false);
-        if (res) counter = (ui *) (mysize + (char *)mem->data);
-        return res;
+    char *value(Entry *e){
+        return arena + e->offset;
     }
-    ui mysize;
-    ui *counter;
     std::string name;
+    ui capacity, arena_size;
+    Header *hdr;
+    char *entries, *arena;
     tpc::Shm mem;
-    tpc::Sem r_sem, w_sem;
 };
 
-
 class Office{
 public:
     using Ptr = std::shared_ptr<Office>;
@@ -544,9 +2156,32 @@ public:
     bool ask(void *question, ui size){
         return input->put(question, size);
     }
+    // Returns false if the server doesn't take the question within `timeout_us` microseconds
+    bool ask(void *question, ui size, long timeout_us){
+        return input->put(question, size, timeout_us);
+    }
     bool wait(void *answer, ui size){
         return output->get(answer, size);
     }
+    // Returns false if there is no answer within `timeout_us` microseconds
+    bool wait(void *answer, ui size, long timeout_us){
+        return output->get(answer, size, timeout_us);
+    }
+    // ask() and wait() under one deadline, `timeout_us` negative - forever
+    bool request(void *question, ui q_size, void *answer, ui a_size, long timeout_us = -1){
+        if (timeout_us < 0) return ask(question, q_size) && wait(answer, a_size);
+        tpc::Deadline deadline(timeout_us);
+        return ask(question, q_size, timeout_us) && wait(answer, a_size, deadline.left_us());
+    }
+    // `count` requests in a row: question i is at questions + i * q_size, its answer goes to
+    // answers + i * a_size. Returns the count of answered ones.
+    ui request_batch(const void *questions, ui q_size, void *answers, ui a_size, ui count, long timeout_us = -1){
+        tpc::Deadline deadline(timeout_us);
+        ui n = 0;
+        while (n < count && request((char *) questions + n * q_size, q_size,
+                                    (char *) answers + n * a_size, a_size, deadline.left_us())) n++;
+        return n;
+    }
     bool look(void *question, ui size){
         return input->get(question, size);
     }
@@ -566,6 +2201,14 @@ public:
     bool put_answer(void *answer){
         return output->put(answer);
     }
+    // Questions go from clients to the server through the input box, answers back through the output
+    // one; their non-blocking calls let event loops drive an office
+    Box::Ptr get_input(){
+        return input;
+    }
+    Box::Ptr get_output(){
+        return output;
+    }
     const std::string & get_name(){
         return myname;
     }
@@ -597,6 +2240,7 @@ public:
     using Ptr = std::shared_ptr<Topic>;
 
     static bool remove(const std::string &name) {
+        tpc::Registry::on_remove(name);
         std::shared_ptr<Topic> t(new Topic(name, 0, 0));
         return t->remove();
     }
@@ -632,12 +2276,14 @@ public:
         DEBUG_MSG("Entered pub in " + name, DF4);
         if (size > msg_size)
             return tpc::uiErr("Pub error: MsgSize is bigger than fixed for topic");
-        auto l = tpc::WriterLock(nlock, WposSRC, wlocks->data, msg_count);
+        auto l = tpc::WriterLock(nlock, WposSRC, wlocks->data, msg_count, PubSRC);
         if (!l.locked)
             return tpc::uiErr("Pub error: WriterLock didn't lock");
         Wpos = l.pos;
         memcpy(data[Wpos], msg, size);
         *Msizes[Wpos] = size;
+        *Mseqs[Wpos] = l.ticket;
+        *Mtimes[Wpos] = tpc::realtime_ns();
         return size;
     }
 
@@ -646,15 +2292,55 @@ public:
     }
 
     ui sub(const void *msg) {
-        DEBUG_MSG("Entered sub in " + name, DF4);
-        if (tpc::interrupted) return 0;
-        DEBUG_MSG("Reader pos: " + std::to_string(Rpos), DF4);
-        auto l = tpc::ReadersLock(rlocks->data[Rpos], Rcounters[Rpos], wlocks->data[Rpos]);
-        if (!l.locked) return 0;
-        ui sz = *Msizes[Rpos];
-        memcpy((void *) msg, data[Rpos], sz);
-        Rpos = (Rpos + 1) % msg_count;
-        return sz;
+        return sub_until(msg, nullptr);
+    }
+
+    // Like sub(), but returns 0 if no message comes within `timeout_us` microseconds;
+    // 0 only takes a message that is already published
+    ui sub(const void *msg, long timeout_us) {
+        if (timeout_us < 0) return sub(msg);
+        auto at = tpc::wall_deadline(timeout_us);
+        return sub_until(msg, &at);
+    }
+
+    // Sequence number (0, 1, ... per topic, a gap means lost messages) and CLOCK_REALTIME publish
+    // time of a received message
+    struct MsgInfo {
+        ui size;
+        ui seq;
+        int64_t time_ns;
+    };
+
+    ui sub(const void *msg, MsgInfo &info, long timeout_us = -1) {
+        if (timeout_us < 0) return sub_until(msg, nullptr, &info);
+        auto at = tpc::wall_deadline(timeout_us);
+        return sub_until(msg, &at, &info);
+    }
+
+    // Takes up to `max` messages in one call: waits up to `timeout_us` (negative - forever) for
+    // the first one, then only takes messages that are already published.
+    // Message i is copied to data + i * msg_size, its size is stored to sizes[i] if given.
+    ui sub_batch(void *data, ui max, ui *sizes = nullptr, long timeout_us = -1) {
+        ui n = 0;
+        while (n < max) {
+            ui sz = sub((char *) data + n * msg_size, 0 == n ? timeout_us : 0);
+            if (0 == sz) break;
+            if (nullptr != sizes) sizes[n] = sz;
+            n++;
+        }
+        return n;
+    }
+
+    // sub_batch() filling MsgInfo of every message
+    ui sub_batch_info(void *data, ui max, MsgInfo *infos, long timeout_us = -1) {
+        ui n = 0;
+        while (n < max && 0 != sub((char *) data + n * msg_size, infos[n], 0 == n ? timeout_us : 0)) n++;
+        return n;
+    }
+
+    // Messages this reader missed because the publisher overwrote them first
+    ui get_dropped() {
+        return dropped;
     }
 
     ui get_msg_size() {
@@ -673,6 +2359,14 @@ public:
         return steady;
     }
 
+    // Whether sub() would find a published message without waiting; for pollers, may be stale
+    bool can_sub() {
+        if (0 != *Rcounters[Rpos]) return true;
+        int v = 0;
+        sem_getvalue(wlocks->data[Rpos], &v);
+        return v > 0;
+    }
+
     const std::string &get_name() {
         return name;
     }
@@ -681,11 +2375,14 @@ public:
         ui msg_size;
         ui msg_count;
         ui writer_pos;
+        ui pub_count;   // sequence number of the next message
     };
 
     static const ui DATA_START = 32;
     static const ui UI_SZ = sizeof(ui);
     static const ui HDR_SZ = sizeof(Header);
+    // Every slot starts with the readers counter, message size, sequence number and publish time
+    static const ui SLOT_HDR = UI_SZ * 4;
 
 private:
     Topic(const std::string &name, ui msg_size, ui msg_count) {
@@ -693,7 +2390,8 @@ private:
         this->name = name;
         this->msg_size = msg_size;
         this->msg_count = msg_count;
-        full_size = DATA_START + (msg_size + UI_SZ * 2) * msg_count;
+        static_assert(sizeof(Header) <= DATA_START, "Topic header doesn't fit");
+        full_size = DATA_START + (msg_size + SLOT_HDR) * msg_count;
         DEBUG_MSG("Full size " << full_size, DF5);
         memory = tpc::ShmMake(name, full_size);
         semCreate = tpc::SemMake(name + "--C");
@@ -703,9 +2401,30 @@ private:
     ui getWpos() {
         auto l = tpc::Lock(nlock);
         ui pos = *WposSRC;
+        next_seq = *PubSRC;
         return pos;
     }
 
+    ui sub_until(const void *msg, const struct timespec *at, MsgInfo *info = nullptr) {
+        DEBUG_MSG("Entered sub in " + name, DF4);
+        if (tpc::interrupted) return 0;
+        DEBUG_MSG("Reader pos: " + std::to_string(Rpos), DF4);
+        auto l = tpc::ReadersLock(rlocks->data[Rpos], Rcounters[Rpos], wlocks->data[Rpos], at);
+        if (!l.locked) return 0;
+        ui sz = *Msizes[Rpos];
+        memcpy((void *) msg, data[Rpos], sz);
+        ui seq = *Mseqs[Rpos];
+        if (seq > next_seq) dropped += seq - next_seq;
+        next_seq = seq + 1;
+        if (nullptr != info) {
+            info->size = sz;
+            info->seq = seq;
+            info->time_ns = *Mtimes[Rpos];
+        }
+        Rpos = (Rpos + 1) % msg_count;
+        return sz;
+    }
+
     bool remove() {
         if (semN != nullptr) semN->remove();
         for (auto &&i : semW) i->remove();
@@ -718,7 +2437,7 @@ private:
     }
 
     bool start(bool create, bool ign_size, bool ign_count) {
-        if (msg_count <= 1) return false;
+        if (msg_count <= 1 && !ign_count) return false;
         DEBUG_MSG("Will start topic " << name << " with flags: create[" << create
         << "], ign_size[" << ign_size << "], ign_count[" << ign_count << "]", DF5);
         if (steady) return true;
@@ -743,7 +2462,9 @@ private:
                 hdr->msg_count = msg_count;
                 hdr->msg_size = msg_size;
                 hdr->writer_pos = 0;
+                hdr->pub_count = 0;
                 WposSRC = &(hdr->writer_pos);
+                PubSRC = &(hdr->pub_count);
                 Rpos = 0;
                 semR.clear();
                 semW.clear();
@@ -752,11 +2473,7 @@ private:
                 for (ui i = 0; i < msg_count; i++)
                     semW.push_back(tpc::SemMake(name + "--w" + std::to_string(i)));
                 create_sems();
-                Rcounters.clear();
-                for (int i = 0; i < msg_count; i++)
-                    Rcounters.push_back((ui *) (mpd + i * (msg_size + UI_SZ * 2)));
-                for (int i = 0; i < msg_count; i++)
-                    Msizes.push_back((ui *) (mpd + i * (msg_size + UI_SZ * 2) + UI_SZ));
+                map_slots(mpd);
                 DEBUG_MSG("Just before Rcounters=0", DF5);
                 for (int i = 0; i < msg_count; i++)
                     (*Rcounters[i]) = 0;
@@ -785,14 +2502,10 @@ private:
                 msg_count = hdr->msg_count;
             }
             WposSRC = &(hdr->writer_pos);
+            PubSRC = &(hdr->pub_count);
             DEBUG_MSG("Just after work with shmem hdr", DF5);
             Rpos = 0;
-            Rcounters.clear();
-            Msizes.clear();
-            for (int i = 0; i < msg_count; i++)
-                Rcounters.push_back((ui *) (mpd + i * (msg_size + UI_SZ * 2)));
-            for (int i = 0; i < msg_count; i++)
-                Msizes.push_back((ui *) (mpd + i * (msg_size + UI_SZ * 2) + UI_SZ));
+            map_slots(mpd);
             DEBUG_MSG("Rconters/Msizes", DF5);
             semR.clear();
             semW.clear();
@@ -808,14 +2521,29 @@ private:
         << ", msg_size=" << msg_size, DF5);
         open_sems();
         DEBUG_MSG("Opened sems", DF5);
-        data.clear();
-        for (int i = 0; i < msg_count; i++)
-            data.push_back(mpd + i * (msg_size + UI_SZ * 2) + UI_SZ * 2);
+        if (!existed) tpc::Registry::on_create(name, tpc::Registry::topic, msg_size, msg_count);
+        registration = tpc::Registry::on_open(name);
         Rpos = getWpos();
         DEBUG_MSG("Topic " << name << " successfully opened", DF5);
         return true;
     }
 
+    void map_slots(char *mpd) {
+        Rcounters.clear();
+        Msizes.clear();
+        Mseqs.clear();
+        Mtimes.clear();
+        data.clear();
+        for (ui i = 0; i < msg_count; i++) {
+            char *slot = mpd + i * (msg_size + SLOT_HDR);
+            Rcounters.push_back((ui *) slot);
+            Msizes.push_back((ui *) (slot + UI_SZ));
+            Mseqs.push_back((ui *) (slot + UI_SZ * 2));
+            Mtimes.push_back((int64_t *) (slot + UI_SZ * 3));
+            data.push_back(slot + SLOT_HDR);
+        }
+    }
+
     bool create_sems() {
         semN->remove();
         if (!semN->create(1)) return tpc::Err("Can't create W_POS semaphore");
@@ -848,14 +2576,868 @@ private:
     bool steady;
     tpc::Shm memory;
     tpc::Sem semN, semCreate;
+    tpc::Registry::Attach registration;
     std::vector<tpc::Sem> semW, semR;
     tpc::SemArr wlocks, rlocks;
     sem_t *nlock;
     std::vector<char *> data;
-    std::vector<ui *> Rcounters, Msizes;
-    ui Wpos, *WposSRC, Rpos;
+    std::vector<ui *> Rcounters, Msizes, Mseqs;
+    std::vector<int64_t *> Mtimes;
+    ui Wpos, *WposSRC, Rpos, *PubSRC;
+    ui next_seq = 0, dropped = 0;
     std::string name;
     ui msg_size, msg_count, full_size;
 };
 
+
+namespace tpc {
+    // Turns readiness of shared memory primitives, which signal through semaphores and futexes
+    // nobody can poll(), into an eventfd for poll/epoll/asyncio loops. One thread checks every
+    // armed source, sleeping with a growing backoff (up to `max_sleep_us`) while none is ready.
+    // A source found ready is disarmed and its id queued until the owner take()s it, drains the
+    // source and arm()s it again, so a busy source costs no checks while it is being drained.
+    class ReadyWatcher {
+    public:
+        using Check = std::function<bool()>;
+        static const long MIN_SLEEP_US = 10;
+
+        explicit ReadyWatcher(long max_sleep_us = 1000) {
+            this->max_sleep_us = max_sleep_us < MIN_SLEEP_US ? MIN_SLEEP_US : max_sleep_us;
+            efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (-1 == efd) Err("Cannot create eventfd for ReadyWatcher");
+            else worker = std::thread([this]() { run(); });
+        }
+
+        ~ReadyWatcher() {
+            {
+                std::lock_guard<std::mutex> g(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            if (worker.joinable()) worker.join();
+            if (-1 != efd) close(efd);
+        }
+
+        // Readable while take() has ids to return; -1 if the watcher couldn't start
+        int fd() {
+            return efd;
+        }
+
+        ui add(Check check, bool armed = true) {
+            std::lock_guard<std::mutex> g(mutex);
+            ui id = next_id++;
+            sources[id] = Source{std::move(check), armed};
+            kick();
+            return id;
+        }
+
+        void remove(ui id) {
+            std::lock_guard<std::mutex> g(mutex);
+            sources.erase(id);
+        }
+
+        void arm(ui id) {
+            std::lock_guard<std::mutex> g(mutex);
+            auto it = sources.find(id);
+            if (sources.end() == it) return;
+            it->second.armed = true;
+            kick();
+        }
+
+        // Ids found ready since the last call
+        std::vector<ui> take() {
+            uint64_t n;
+            if (-1 == read(efd, &n, sizeof(n)) && EAGAIN != errno) Err("ReadyWatcher eventfd read failed");
+            std::vector<ui> res;
+            std::lock_guard<std::mutex> g(mutex);
+            res.swap(ready);
+            return res;
+        }
+
+    private:
+        struct Source {
+            Check check;
+            bool armed;
+        };
+
+        void kick() {
+            kicked = true;
+            wake.notify_all();
+        }
+
+        void run() {
+            long sleep_us = 0;
+            std::unique_lock<std::mutex> l(mutex);
+            while (!stopping) {
+                bool fired = false;
+                for (auto &s : sources) {
+                    if (!s.second.armed || !s.second.check()) continue;
+                    s.second.armed = false;
+                    ready.push_back(s.first);
+                    fired = true;
+                }
+                if (fired) {
+                    uint64_t one = 1;
+                    if (-1 == write(efd, &one, sizeof(one))) Err("ReadyWatcher eventfd write failed");
+                    sleep_us = 0;
+                    continue;
+                }
+                sleep_us = 0 == sleep_us ? MIN_SLEEP_US : std::min(2 * sleep_us, max_sleep_us);
+                wake.wait_for(l, std::chrono::microseconds(sleep_us));
+                if (kicked) sleep_us = 0;
+                kicked = false;
+            }
+        }
+
+        int efd;
+        long max_sleep_us;
+        ui next_id = 1;
+        bool stopping = false, kicked = false;
+        std::map<ui, Source> sources;
+        std::vector<ui> ready;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::thread worker;
+    };
+}
+
+
+// Request/response services on top of the primitives above. Clients put requests into one
+// MPMC WorkQueue shared by all of them; every client owns a response queue, and each request
+// carries the client's address and an id, so an answer always reaches the client that asked.
+namespace service {
+    namespace util {
+        enum : ui {NEEDS_ANSWER = 1};
+        // EXPIRED - the server dropped the request after its deadline, SHED - the request queue was
+        // over the server's limit, so the client didn't send it or the server refused it unhandled,
+        // TIMEOUT - no answer in time
+        enum : ui {STATUS_OK = 0, STATUS_DENIED = 1, STATUS_EXPIRED = 2, STATUS_SHED = 3, STATUS_TIMEOUT = 4,
+                   STATUS_FAILED = 5};
+
+        // `slot` and `generation` address the client's response channel in the ChannelPool
+        struct RequestHeader {
+            ui slot;
+            ui generation;
+            ui id;
+            ui size;
+            ui flags;
+            int64_t deadline;   // tpc::monotonic_ns() after which nobody waits for the answer, 0 - none
+        };
+
+        struct ResponseHeader {
+            ui generation;
+            ui id;
+            ui size;
+            ui status;
+        };
+
+        // Parameters of a running server, published in a seqlock Variable for its clients
+        struct Info {
+            ui size_in;
+            ui size_out;
+            ui msg_in_cnt;
+            ui msg_out_cnt;
+            ui max_clients;
+            ui queue_limit;     // requests beyond this many queued are shed, 0 - no limit
+        };
+
+        std::string req_name(const std::string &name) {
+            return name + "-req";
+        }
+
+        std::string info_name(const std::string &name) {
+            return name + "-info";
+        }
+
+        std::string resp_pool_name(const std::string &name) {
+            return name + "-resp";
+        }
+
+        std::string resp_topic_name(const std::string &name, ui pid, ui tid) {
+            return name + "-resp" + std::to_string(pid) + "-" + std::to_string(tid);
+        }
+
+        // Response channels of all clients of a service in one shared memory segment. A client
+        // claims a slot once at connect time and the server addresses answers by slot index, so
+        // answering a request builds no names and opens no shared memory.
+        // A slot of a dead process is reclaimed by the next client; `generation` grows with every
+        // claim, so answers meant for a previous owner are recognized and dropped.
+        class ChannelPool {
+        public:
+            using Ptr = std::shared_ptr<ChannelPool>;
+
+            struct Slot {
+                alignas(64) std::atomic<uint32_t> owner;    // pid of the client, 0 if free
+                std::atomic<uint32_t> generation;
+                tpc::MPMCRing::Header ring;
+            };
+
+            static Ptr open_create(const std::string &name, ui msg_size, ui slots, ui depth) {
+                if (0 == msg_size || 0 == slots || 0 == depth) return nullptr;
+                Ptr loc(new ChannelPool(name, msg_size, slots, depth));
+                if (!loc->mem->exists()) {
+                    loc->mem->remove();
+                    if (!loc->mem->create()) return nullptr;
+                }
+                if (!loc->open()) return nullptr;
+                return loc;
+            }
+
+            static Ptr just_open(const std::string &name, ui msg_size, ui slots, ui depth) {
+                if (0 == msg_size || 0 == slots || 0 == depth) return nullptr;
+                Ptr loc(new ChannelPool(name, msg_size, slots, depth));
+                if (!loc->mem->exists()) return nullptr;
+                if (!loc->open()) return nullptr;
+                return loc;
+            }
+
+            static bool remove(const std::string &name) {
+                return tpc::SharedMemory(name, 0).remove();
+            }
+
+            // Takes a free slot (or one of a dead process), returns false if all are in use
+            bool claim(ui &index, ui &generation) {
+                auto pid = (uint32_t) getpid();
+                for (ui i = 0; i < slots; i++) {
+                    Slot *s = slot(i);
+                    uint32_t owner = s->owner.load(std::memory_order_acquire);
+                    if (0 != owner && (0 == kill((pid_t) owner, 0) || ESRCH != errno)) continue;
+                    if (!s->owner.compare_exchange_strong(owner, pid, std::memory_order_acq_rel)) continue;
+                    generation = s->generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+                    index = i;
+                    // Leftovers of the previous owner only take space
+                    std::vector<char> junk(msg_size * depth);
+                    while (0 != rings[i].try_get_batch(junk.data(), msg_size, depth, nullptr));
+                    return true;
+                }
+                return tpc::Err("All " + std::to_string(slots) + " response channels of " + name + " are in use");
+            }
+
+            void release(ui index) {
+                if (index < slots) slot(index)->owner.store(0, std::memory_order_release);
+            }
+
+            // Whether slot `index` still belongs to the client that sent a request with `generation`
+            bool owned(ui index, ui generation) {
+                if (index >= slots) return false;
+                Slot *s = slot(index);
+                return 0 != s->owner.load(std::memory_order_acquire)
+                       && generation == s->generation.load(std::memory_order_acquire);
+            }
+
+            tpc::MPMCRing &channel(ui index) {
+                return rings[index];
+            }
+
+            ui get_depth() {
+                return depth;
+            }
+
+            bool remove() {
+                return mem->remove();
+            }
+
+        private:
+            ChannelPool(const std::string &name, ui msg_size, ui slots, ui depth) {
+                this->name = name;
+                this->msg_size = msg_size;
+                this->slots = slots;
+                this->depth = tpc::MPMCRing::round_depth(depth);
+                stride = (sizeof(Slot) + tpc::MPMCRing::slots_size(msg_size, this->depth) + tpc::CACHE_LINE - 1)
+                         & ~(tpc::CACHE_LINE - 1);
+                mem = tpc::ShmMake(name, stride * slots);
+            }
+
+            bool open() {
+                if (!mem->open(false)) return false;
+                rings.resize(slots);
+                for (ui i = 0; i < slots; i++)
+                    rings[i].attach(&slot(i)->ring, (char *) slot(i) + sizeof(Slot), msg_size, depth);
+                return true;
+            }
+
+            Slot *slot(ui index) {
+                return (Slot *) ((char *) mem->data + index * stride);
+            }
+
+            std::string name;
+            ui msg_size, slots, depth, stride;
+            std::vector<tpc::MPMCRing> rings;
+            tpc::Shm mem;
+        };
+
+        template<size_t size_in, size_t size_out>
+        class AsyncServer;
+
+        template<size_t size_in, size_t size_out>
+        class Request {
+        public:
+            using Server = std::shared_ptr<AsyncServer<size_in, size_out>>;
+
+            Request(const Server &server, const char *msg) {
+                this->server = server;
+                memcpy(&hdr, msg, sizeof(RequestHeader));
+                memcpy(buf, msg + sizeof(RequestHeader), hdr.size);
+            }
+
+            void *data() {
+                return buf;
+            }
+
+            ui size() {
+                return hdr.size;
+            }
+
+            bool requires_answer() {
+                return !done && 0 != (hdr.flags & NEEDS_ANSWER);
+            }
+
+            // Whether the client has given up waiting; long handlers may check it to stop early
+            bool expired() {
+                return 0 != hdr.deadline && tpc::monotonic_ns() >= hdr.deadline;
+            }
+
+            ui answer(void *data, ui size) {
+                if (!requires_answer() || size > size_out) return 0;
+                done = true;
+                return server->respond(hdr, STATUS_OK, data, size) ? size : 0;
+            }
+
+            ui answer(void *data) {
+                return answer(data, size_out);
+            }
+
+            // Client's ask() returns 0; `data` (size_out bytes, may be nullptr) is passed along
+            bool deny(void *data = nullptr) {
+                if (!requires_answer()) return false;
+                done = true;
+                return server->respond(hdr, STATUS_DENIED, data, nullptr == data ? 0 : size_out);
+            }
+
+            const RequestHeader &header() {
+                return hdr;
+            }
+
+        private:
+            Server server;
+            RequestHeader hdr;
+            bool done = false;
+            char buf[size_in];
+        };
+
+        template<size_t size_in, size_t size_out>
+        class AsyncServer : public std::enable_shared_from_this<AsyncServer<size_in, size_out>> {
+        public:
+            using Ptr = std::shared_ptr<AsyncServer<size_in, size_out>>;
+            using RequestPtr = std::shared_ptr<Request<size_in, size_out>>;
+            using Handler = std::function<void(Request<size_in, size_out> &)>;
+            static const ui MSG_IN = sizeof(RequestHeader) + size_in;
+            static const ui MSG_OUT = sizeof(ResponseHeader) + size_out;
+
+            static Ptr create(const std::string &name, ui msg_in_cnt, ui msg_out_cnt, ui max_clients, ui queue_limit) {
+                if (0 == max_clients) return nullptr;
+                Info info = {size_in, size_out, msg_in_cnt, msg_out_cnt < 2 ? 2 : msg_out_cnt, max_clients, queue_limit};
+                auto var = Variable::open_create(info_name(name), sizeof(Info), Variable::seqlock);
+                if (nullptr == var) return nullptr;
+                Info found;
+                if (0 != var->version()) {
+                    var->read(&found);
+                    if (found.size_in != size_in || found.size_out != size_out) {
+                        tpc::Err("Service " + name + " exists with other message sizes");
+                        return nullptr;
+                    }
+                    info = found;
+                } else var->write(&info);
+                auto queue = WorkQueue::open_create(req_name(name), MSG_IN, info.msg_in_cnt);
+                if (nullptr == queue) return nullptr;
+                auto pool = ChannelPool::open_create(resp_pool_name(name), MSG_OUT, info.max_clients, info.msg_out_cnt);
+                if (nullptr == pool) return nullptr;
+                Ptr srv(new AsyncServer(name, info, queue, pool));
+                return srv;
+            }
+
+            // Blocks until a request arrives, returns nullptr if interrupted
+            RequestPtr wait_request() {
+                return wait_request(-1);
+            }
+
+            // Returns nullptr if no request arrives within `timeout_us` microseconds.
+            // Requests past their deadline are dropped here, before any work is done on them, and
+            // while the queue is over `queue_limit` requests are shed, whatever their clients checked.
+            RequestPtr wait_request(long timeout_us) {
+                char msg[MSG_IN];
+                auto hdr = (RequestHeader *) msg;
+                while (queue->get(msg, MSG_IN, timeout_us)) {
+                    if (0 != hdr->deadline && tpc::monotonic_ns() >= hdr->deadline) {
+                        // Lets a pipelined client reuse the request slot right away
+                        if (hdr->flags & NEEDS_ANSWER) respond(*hdr, STATUS_EXPIRED, nullptr, 0);
+                        dropped_cnt++;
+                    } else if (0 != info.queue_limit && queue->count() >= info.queue_limit) {
+                        if (hdr->flags & NEEDS_ANSWER) respond(*hdr, STATUS_SHED, nullptr, 0);
+                        shed_cnt++;
+                    } else return std::make_shared<Request<size_in, size_out>>(this->shared_from_this(), msg);
+                }
+                return nullptr;
+            }
+
+            // Runs `handler` for every request on `threads` worker threads in each of `processes`
+            // processes (this one and processes - 1 forked children) until stop() or a signal.
+            // Workers share the request queue, so a free worker takes the next request and its
+            // answer goes to whoever asked. A request left unanswered by the handler is denied.
+            bool serve(const Handler &handler, ui threads, ui processes = 1) {
+                if (0 == threads || 0 == processes) return false;
+                stopping = false;
+                std::vector<pid_t> children;
+                for (ui i = 1; i < processes; i++) {
+                    pid_t pid = fork();
+                    if (pid < 0) {
+                        tpc::Err("Cannot fork service worker");
+                        break;
+                    }
+                    if (0 == pid) {
+                        tpc::init_system();
+                        run_workers(handler, threads);
+                        _exit(0);
+                    }
+                    children.push_back(pid);
+                }
+                run_workers(handler, threads);
+                for (auto pid : children) kill(pid, SIGTERM);
+                for (auto pid : children) waitpid(pid, nullptr, 0);
+                return true;
+            }
+
+            // Makes serve() return once the workers finish their current requests
+            void stop() {
+                stopping = true;
+            }
+
+            bool respond(const RequestHeader &req, ui status, const void *data, ui size) {
+                // The client is gone or its slot was taken over by another one
+                if (!pool->owned(req.slot, req.generation)) return false;
+                char msg[MSG_OUT];
+                auto hdr = (ResponseHeader *) msg;
+                hdr->generation = req.generation;
+                hdr->id = req.id;
+                hdr->size = size;
+                hdr->status = status;
+                if (size > 0) memcpy(msg + sizeof(ResponseHeader), data, size);
+                // Never block on a client that stopped reading its answers
+                if (pool->channel(req.slot).try_put(msg, MSG_OUT)) return true;
+                undelivered_cnt++;
+                return false;
+            }
+
+            // Count of requests dropped after their deadline
+            ui dropped() {
+                return dropped_cnt;
+            }
+
+            // Count of requests refused because the queue was over `queue_limit`
+            ui shed() {
+                return shed_cnt;
+            }
+
+            // Count of answers that didn't fit into their client's response channel
+            ui undelivered() {
+                return undelivered_cnt;
+            }
+
+            const std::string &get_name() {
+                return name;
+            }
+
+        private:
+            AsyncServer(const std::string &name, const Info &info, const WorkQueue::Ptr &queue,
+                        const ChannelPool::Ptr &pool) {
+                this->name = name;
+                this->info = info;
+                this->queue = queue;
+                this->pool = pool;
+            }
+
+            // How often idle workers look at the stop flag
+            static const long POLL_US = 100000;
+
+            void run_workers(const Handler &handler, ui threads) {
+                auto work = [this, &handler]() {
+                    while (!stopping) {
+                        auto req = wait_request(POLL_US);
+                        // Signals land in a single thread, tell the others
+                        if (tpc::interrupted) stopping = true;
+                        if (nullptr == req) continue;
+                        handler(*req);
+                        if (req->requires_answer()) req->deny();
+                    }
+                };
+                std::vector<std::thread> pool;
+                for (ui i = 1; i < threads; i++) pool.emplace_back(work);
+                work();
+                for (auto &t : pool) t.join();
+            }
+
+            std::string name;
+            Info info;
+            WorkQueue::Ptr queue;
+            ChannelPool::Ptr pool;
+            std::atomic<bool> stopping{false};
+            std::atomic<ui> dropped_cnt{0}, shed_cnt{0}, undelivered_cnt{0};
+        };
+
+        // Client side of a service: shared request queue plus own response queue
+        template<size_t size_in, size_t size_out>
+        class Connection {
+        public:
+            static const ui MSG_IN = sizeof(RequestHeader) + size_in;
+            static const ui MSG_OUT = sizeof(ResponseHeader) + size_out;
+
+            ~Connection() {
+                if (nullptr != pool) pool->release(slot);
+            }
+
+        protected:
+            // Claims a response channel in the service's ChannelPool
+            bool connect(const std::string &name) {
+                auto var = Variable::just_open(info_name(name), sizeof(Info), Variable::seqlock);
+                if (nullptr == var) return false;
+                Info info;
+                if (!var->read(&info)) return false;
+                if (info.size_in != size_in || info.size_out != size_out)
+                    return tpc::Err("Service " + name + " has other message sizes");
+                queue = WorkQueue::just_open(req_name(name), MSG_IN, info.msg_in_cnt);
+                if (nullptr == queue) return false;
+                queue_limit = info.queue_limit;
+                auto found = ChannelPool::just_open(resp_pool_name(name), MSG_OUT, info.max_clients, info.msg_out_cnt);
+                if (nullptr == found || !found->claim(slot, generation)) return false;
+                pool = found;
+                responses = &pool->channel(slot);
+                return true;
+            }
+
+            // Returns STATUS_OK if the request was queued
+            ui send(const void *request, ui request_size, ui flags, ui id, tpc::Deadline deadline = tpc::Deadline()) {
+                if (request_size > size_in) return STATUS_FAILED;
+                // Shed load before queueing, the server would refuse the request unhandled anyway
+                if (0 != queue_limit && queue->count() >= queue_limit) return STATUS_SHED;
+                char msg[MSG_IN];
+                auto hdr = (RequestHeader *) msg;
+                hdr->slot = slot;
+                hdr->generation = generation;
+                hdr->id = id;
+                hdr->size = request_size;
+                hdr->flags = flags;
+                hdr->deadline = deadline.ns();
+                memcpy(msg + sizeof(RequestHeader), request, request_size);
+                if (queue->put(msg, MSG_IN, deadline.left_us())) return STATUS_OK;
+                return deadline.expired() ? STATUS_TIMEOUT : STATUS_FAILED;
+            }
+
+            // Blocks for the next answer to this client, skipping ones meant for a previous owner of the slot
+            bool next_answer(char *msg, tpc::Deadline deadline = tpc::Deadline()) {
+                auto hdr = (ResponseHeader *) msg;
+                do {
+                    if (1 != responses->get_batch(msg, MSG_OUT, 1, nullptr, deadline)) return false;
+                } while (hdr->generation != generation);
+                return true;
+            }
+
+            WorkQueue::Ptr queue;
+            ChannelPool::Ptr pool;
+            tpc::MPMCRing *responses = nullptr;
+            ui slot = 0, generation = 0, queue_limit = 0;
+        };
+
+        // Blocking client with one request in flight; not thread-safe, use one per thread
+        template<size_t size_in, size_t size_out>
+        class SyncClient : public Connection<size_in, size_out> {
+        public:
+            using Ptr = std::shared_ptr<SyncClient<size_in, size_out>>;
+            using Base = Connection<size_in, size_out>;
+
+            static Ptr create(const std::string &name) {
+                Ptr cli(new SyncClient());
+                if (!cli->connect(name)) return nullptr;
+                return cli;
+            }
+
+            ui ask(void *request, ui request_size, void *response) {
+                return ask(request, request_size, response, -1);
+            }
+
+            // Gives up after `timeout_us` microseconds; the server won't start on the request after that
+            ui ask(void *request, ui request_size, void *response, long timeout_us) {
+                tpc::Deadline deadline(timeout_us);
+                last_status = this->send(request, request_size, NEEDS_ANSWER, ++last_id, deadline);
+                if (STATUS_OK != last_status) return 0;
+                char msg[Base::MSG_OUT];
+                auto hdr = (ResponseHeader *) msg;
+                do {
+                    if (!this->next_answer(msg, deadline)) {
+                        last_status = deadline.expired() ? STATUS_TIMEOUT : STATUS_FAILED;
+                        return 0;
+                    }
+                } while (hdr->id != last_id);   // answer to an abandoned request
+                last_status = hdr->status;
+                if (STATUS_OK != hdr->status) return 0;
+                memcpy(response, msg + sizeof(ResponseHeader), hdr->size);
+                return hdr->size;
+            }
+
+            ui ask(void *request, void *response) {
+                return ask(request, size_in, response);
+            }
+
+            // Why the last ask() returned 0: STATUS_DENIED, STATUS_TIMEOUT, ...
+            ui status() {
+                return last_status;
+            }
+
+            bool inform(void *request, ui request_size) {
+                return STATUS_OK == this->send(request, request_size, 0, ++last_id);
+            }
+
+            bool inform(void *request) {
+                return inform(request, size_in);
+            }
+
+        private:
+            SyncClient() = default;
+
+            ui last_id = 0, last_status = STATUS_OK;
+        };
+
+        template<size_t size_out>
+        struct Answer {
+            bool ok;
+            ui status;
+            ui size;
+            char data[size_out];
+        };
+
+        // Pipelined client: up to `max_in_flight` requests are outstanding at once, answers are
+        // matched by correlation id in any order by a receiver thread, which completes the
+        // returned future or runs the callback. Thread-safe.
+        template<size_t size_in, size_t size_out>
+        class AsyncClient : public Connection<size_in, size_out> {
+        public:
+            using Ptr = std::shared_ptr<AsyncClient<size_in, size_out>>;
+            using Base = Connection<size_in, size_out>;
+            using Callback = std::function<void(bool ok, const void *data, ui size)>;
+
+            static Ptr create(const std::string &name, ui max_in_flight) {
+                if (0 == max_in_flight) return nullptr;
+                Ptr cli(new AsyncClient());
+                if (!cli->connect(name)) return nullptr;
+                // Every answer must fit into the response channel, one place is kept for the stop message
+                ui depth = cli->responses->get_depth();
+                cli->reserve(max_in_flight < depth ? max_in_flight : depth - 1);
+                cli->receiver = std::thread([cli_raw = cli.get()]() { cli_raw->receive(); });
+                return cli;
+            }
+
+            ~AsyncClient() {
+                if (!receiver.joinable()) return;
+                char msg[Base::MSG_OUT] = {};
+                ((ResponseHeader *) msg)->generation = this->generation;
+                ((ResponseHeader *) msg)->id = STOP;
+                this->responses->put(msg, Base::MSG_OUT);
+                receiver.join();
+            }
+
+            // Blocks while `max_in_flight` requests are outstanding; the future gets `ok == false`
+            // if the request was denied, couldn't be sent or got no answer within `timeout_us`
+            // microseconds (negative - no timeout), `status` tells which. A request that timed out
+            // stays outstanding until its late answer arrives, so answers always fit the channel.
+            std::future<Answer<size_out>> ask(const void *request, ui request_size, long timeout_us = -1) {
+                std::promise<Answer<size_out>> promise;
+                auto future = promise.get_future();
+                ui id;
+                tpc::Deadline deadline;
+                ui slot = acquire(timeout_us, std::move(promise), nullptr, id, deadline);
+                submit(slot, id, deadline, request, request_size, timeout_us);
+                return future;
+            }
+
+            // `callback` runs on the receiver thread
+            void ask(const void *request, ui request_size, Callback callback, long timeout_us = -1) {
+                ui id;
+                tpc::Deadline deadline;
+                ui slot = acquire(timeout_us, std::promise<Answer<size_out>>(), std::move(callback), id, deadline);
+                submit(slot, id, deadline, request, request_size, timeout_us);
+            }
+
+            bool inform(const void *request, ui request_size) {
+                return STATUS_OK == this->send(request, request_size, 0, 0);
+            }
+
+            ui in_flight() {
+                std::lock_guard<std::mutex> l(mutex);
+                return pending.size() - free.size();
+            }
+
+        private:
+            static const ui STOP = ~(ui) 0;
+            static const ui WAKE = STOP - 1;
+            // Longest sleep of the receiver while requests with deadlines are outstanding, so it
+            // notices a new deadline earlier than the one it sleeps for
+            static const long TICK_US = 1000;
+
+            struct Pending {
+                ui id = 0;
+                bool late = false;      // timed out, the slot waits for the server's answer
+                tpc::Deadline deadline;
+                Callback callback;
+                std::promise<Answer<size_out>> promise;
+            };
+
+            AsyncClient() = default;
+
+            void reserve(ui max_in_flight) {
+                pending = std::vector<Pending>(max_in_flight);
+                for (ui i = max_in_flight; i > 0; i--) free.push_back(i - 1);
+            }
+
+            // The completion is stored before the id is published, as the receiver may expire the
+            // request (and the slot be reused) as soon as the mutex is released; the caller gets
+            // the id and the deadline, which starts once a slot is free
+            ui acquire(long timeout_us, std::promise<Answer<size_out>> promise, Callback callback, ui &id,
+                       tpc::Deadline &deadline) {
+                std::unique_lock<std::mutex> l(mutex);
+                slot_free.wait(l, [this]() { return !free.empty(); });
+                ui slot = free.back();
+                free.pop_back();
+                pending[slot].promise = std::move(promise);
+                pending[slot].callback = std::move(callback);
+                // id encodes the slot, the sequence part tells answers to reused slots apart
+                id = (++seq) * pending.size() + slot;
+                deadline = tpc::Deadline(timeout_us);
+                pending[slot].id = id;
+                pending[slot].deadline = deadline;
+                return slot;
+            }
+
+            void submit(ui slot, ui id, const tpc::Deadline &deadline, const void *request, ui request_size,
+                        long timeout_us) {
+                // A receiver sleeping without timeout has to start watching the deadline
+                if (timeout_us >= 0 && idle.exchange(false)) {
+                    char msg[Base::MSG_OUT] = {};
+                    ((ResponseHeader *) msg)->generation = this->generation;
+                    ((ResponseHeader *) msg)->id = WAKE;
+                    this->responses->try_put(msg, Base::MSG_OUT);
+                }
+                ui status = this->send(request, request_size, NEEDS_ANSWER, id, deadline);
+                if (STATUS_OK != status) complete(slot, id, status, nullptr, 0);
+            }
+
+            // Completes request `id` unless it was completed already (answered, timed out). With
+            // `late` the slot stays taken until the answer arrives or the request turns out unsent.
+            void complete(ui slot, ui id, ui status, const void *data, ui size, bool late = false) {
+                Pending &p = pending[slot];
+                Callback callback;
+                std::promise<Answer<size_out>> promise;
+                {
+                    std::lock_guard<std::mutex> l(mutex);
+                    if (p.id != id) return;
+                    if (p.late) {
+                        p.id = 0;
+                        p.late = false;
+                        free.push_back(slot);
+                        slot_free.notify_one();
+                        return;
+                    }
+                    if (late) p.late = true;
+                    else p.id = 0;
+                    callback = std::move(p.callback);
+                    p.callback = nullptr;
+                    promise = std::move(p.promise);
+                }
+                if (callback) callback(STATUS_OK == status, data, size);
+                else {
+                    Answer<size_out> answer;
+                    answer.ok = STATUS_OK == status;
+                    answer.status = status;
+                    answer.size = size;
+                    if (size > 0) memcpy(answer.data, data, size);
+                    promise.set_value(answer);
+                }
+                if (late) return;
+                std::lock_guard<std::mutex> l(mutex);
+                free.push_back(slot);
+                slot_free.notify_one();
+            }
+
+            // Fails requests past their deadline, returns how long to wait for the next one
+            long expire() {
+                std::vector<std::pair<ui, ui>> late;
+                long wait = -1;
+                {
+                    std::lock_guard<std::mutex> l(mutex);
+                    for (ui i = 0; i < pending.size(); i++) {
+                        if (0 == pending[i].id || pending[i].late) continue;
+                        long left = pending[i].deadline.left_us();
+                        if (0 == left) late.emplace_back(i, pending[i].id);
+                        else if (left > 0 && (wait < 0 || left < wait)) wait = left;
+                    }
+                }
+                // The server answers every request it takes, even one past its deadline
+                for (auto &l : late) complete(l.first, l.second, STATUS_TIMEOUT, nullptr, 0, true);
+                if (wait < 0) return -1;
+                return wait > TICK_US ? TICK_US : wait;
+            }
+
+            void receive() {
+                char msg[Base::MSG_OUT];
+                auto hdr = (ResponseHeader *) msg;
+                while (true) {
+                    idle = true;
+                    long wait = expire();
+                    if (wait >= 0) idle = false;
+                    tpc::Deadline wake(wait);
+                    if (!this->next_answer(msg, wake)) {
+                        if (wake.expired()) continue;
+                        break;
+                    }
+                    if (STOP == hdr->id) break;
+                    if (WAKE == hdr->id) continue;
+                    complete(hdr->id % pending.size(), hdr->id, hdr->status, msg + sizeof(ResponseHeader), hdr->size);
+                }
+            }
+
+            std::vector<Pending> pending;
+            std::vector<ui> free;
+            ui seq = 0;
+            std::mutex mutex;
+            std::condition_variable slot_free;
+            std::atomic<bool> idle{false};
+            std::thread receiver;
+        };
+    }
+
+    template<size_t size_in, size_t size_out>
+    std::shared_ptr<util::AsyncServer<size_in, size_out>>
+    create_async_server(const std::string &name, ui msg_in_cnt, ui msg_out_cnt, ui max_clients = 64,
+                        ui queue_limit = 0) {
+        return util::AsyncServer<size_in, size_out>::create(name, msg_in_cnt, msg_out_cnt, max_clients, queue_limit);
+    }
+
+    template<size_t size_in, size_t size_out>
+    std::shared_ptr<util::SyncClient<size_in, size_out>> create_sync_client(const std::string &name) {
+        return util::SyncClient<size_in, size_out>::create(name);
+    }
+
+    template<size_t size_in, size_t size_out>
+    std::shared_ptr<util::AsyncClient<size_in, size_out>>
+    create_async_client(const std::string &name, ui max_in_flight) {
+        return util::AsyncClient<size_in, size_out>::create(name, max_in_flight);
+    }
+
+    // Removes request queue, response channels and server parameters
+    bool remove(const std::string &name) {
+        WorkQueue::remove(util::req_name(name));
+        util::ChannelPool::remove(util::resp_pool_name(name));
+        Variable::remove(util::info_name(name));
+        return true;
+    }
+}
+
 #endif
\ No newline at end of file
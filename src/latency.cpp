@@ -0,0 +1,143 @@
+// Open-loop latency measurement for Topic pub/sub and Office ask/answer.
+//
+// Messages are sent on a fixed schedule (start + i / rate) regardless of how
+// long the previous send took, and latency is measured from the intended send
+// time, so stalls of the system under test show up as queueing delay instead
+// of being hidden by a slower send loop (coordinated omission).
+//
+// usage: latency <topic|office> [name] [rate msg/s] [seconds] [msg_size] [msg_count]
+
+#include "../lib/topic.hpp"
+#include "../lib/histogram.hpp"
+#include <cstdio>
+#include <chrono>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+static const ui LAST = ~(ui) 0;
+
+struct Probe {
+    ui seq;
+    int64_t intended;   // steady_clock nanoseconds
+};
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static void wait_until(int64_t t) {
+    auto tp = Clock::time_point(std::chrono::nanoseconds(t));
+    while (Clock::now() < tp) {
+        if (tp - Clock::now() > std::chrono::microseconds(100))
+            std::this_thread::sleep_until(tp - std::chrono::microseconds(50));
+    }
+}
+
+int run_topic(const std::string &name, ui rate, ui seconds, ui msg_size, ui msg_count) {
+    Topic::remove(name);
+    auto pub = Topic::spawn_create(name, msg_size, msg_count);
+    auto sub = Topic::spawn(name, msg_size, msg_count);
+    if (nullptr == pub || nullptr == sub) {
+        std::cout << "Cannot create topic " << name << std::endl;
+        return 1;
+    }
+    ui total = rate * seconds;
+    tpc::Histogram hist;
+    ui received = 0;
+    std::thread reader([&]() {
+        std::vector<char> buf(msg_size);
+        auto p = (Probe *) buf.data();
+        while (!tpc::interrupted) {
+            if (0 == sub->sub(buf.data())) continue;
+            if (LAST == p->seq) break;
+            int64_t d = now_ns() - p->intended;
+            hist.record(d > 0 ? (uint64_t) d : 0);
+            received++;
+        }
+    });
+    std::vector<char> buf(msg_size, 0);
+    auto p = (Probe *) buf.data();
+    int64_t period = 1000000000ll / rate;
+    int64_t start = now_ns() + 1000000;
+    for (ui i = 0; i < total && !tpc::interrupted; i++) {
+        p->seq = i;
+        p->intended = start + (int64_t) i * period;
+        wait_until(p->intended);
+        pub->pub(buf.data());
+    }
+    p->seq = LAST;
+    pub->pub(buf.data());
+    reader.join();
+    std::cout << "topic " << name << ": rate=" << rate << "/s sent=" << total
+              << " received=" << received << " lost=" << (total > received ? total - received : 0) << std::endl;
+    hist.print(std::cout, "us", 1000.0);
+    Topic::remove(name);
+    return 0;
+}
+
+int run_office(const std::string &name, ui rate, ui seconds, ui msg_size) {
+    Office::remove(name);
+    auto server = Office::create(name, msg_size, msg_size);
+    auto client = Office::just_open(name, msg_size, msg_size);
+    if (nullptr == server || nullptr == client) {
+        std::cout << "Cannot create office " << name << std::endl;
+        return 1;
+    }
+    std::thread worker([&]() {
+        std::vector<char> buf(msg_size);
+        auto p = (Probe *) buf.data();
+        while (!tpc::interrupted) {
+            if (!server->get_question(buf.data())) break;
+            server->put_answer(buf.data());
+            if (LAST == p->seq) break;
+        }
+    });
+    ui total = rate * seconds;
+    tpc::Histogram hist;
+    std::vector<char> q(msg_size, 0), a(msg_size, 0);
+    auto p = (Probe *) q.data();
+    int64_t period = 1000000000ll / rate;
+    int64_t start = now_ns() + 1000000;
+    for (ui i = 0; i < total && !tpc::interrupted; i++) {
+        p->seq = i;
+        p->intended = start + (int64_t) i * period;
+        wait_until(p->intended);
+        if (!client->ask(q.data()) || !client->get_answer(a.data())) break;
+        int64_t d = now_ns() - p->intended;
+        hist.record(d > 0 ? (uint64_t) d : 0);
+    }
+    p->seq = LAST;
+    client->ask(q.data());
+    client->get_answer(a.data());
+    worker.join();
+    std::cout << "office " << name << ": rate=" << rate << "/s round trips=" << hist.count() << std::endl;
+    hist.print(std::cout, "us", 1000.0);
+    Office::remove(name);
+    return 0;
+}
+
+int main(int argc, char **args) {
+    std::string mode = "topic";
+    std::string name = "/clap_latency";
+    ui rate = 10000;
+    ui seconds = 5;
+    ui msg_size = 64;
+    ui msg_count = 64;
+    if (argc > 1) mode = std::string(args[1]);
+    if (argc > 2) name = std::string(args[2]);
+    if (argc > 3) sscanf(args[3], "%lu", &rate);
+    if (argc > 4) sscanf(args[4], "%lu", &seconds);
+    if (argc > 5) sscanf(args[5], "%lu", &msg_size);
+    if (argc > 6) sscanf(args[6], "%lu", &msg_count);
+    if (msg_size < sizeof(Probe)) msg_size = sizeof(Probe);
+    if (0 == rate || 0 == seconds) {
+        std::cout << "rate and seconds should be > 0" << std::endl;
+        return 1;
+    }
+    tpc::init_system();
+    if (mode == "topic") return run_topic(name, rate, seconds, msg_size, msg_count);
+    if (mode == "office") return run_office(name, rate, seconds, msg_size);
+    std::cout << "usage: latency <topic|office> [name] [rate] [seconds] [msg_size] [msg_count]" << std::endl;
+    return 1;
+}
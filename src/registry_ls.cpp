@@ -0,0 +1,42 @@
+// Lists the topics, boxes and variables of the registry (tpc::Registry).
+//
+// usage: registry_ls [name prefix]
+
+#include "../lib/topic.hpp"
+#include <chrono>
+#include <cstdio>
+
+static const char *kind_name(tpc::Registry::Kind kind) {
+    switch (kind) {
+        case tpc::Registry::topic: return "topic";
+        case tpc::Registry::box: return "box";
+        case tpc::Registry::variable: return "variable";
+        default: return "?";
+    }
+}
+
+int main(int argc, char **args) {
+    std::string prefix = argc > 1 ? args[1] : "";
+    auto registry = tpc::Registry::get();
+    if (nullptr == registry) {
+        std::cout << "Registry is off or can't be opened" << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto all = registry->list();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    std::sort(all.begin(), all.end(), [](const tpc::Registry::Info &a, const tpc::Registry::Info &b) {
+        return a.name < b.name;
+    });
+    printf("%-9s %-32s %10s %10s %8s %-19s %8s\n", "kind", "name", "msg_size", "msg_count", "pid", "created", "attached");
+    for (auto &i : all) {
+        if (0 != i.name.compare(0, prefix.size(), prefix)) continue;
+        time_t secs = (time_t) (i.created_ns / 1000000000);
+        char created[32];
+        strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", localtime(&secs));
+        printf("%-9s %-32s %10lu %10lu %8d %-19s %8lu\n", kind_name(i.kind), i.name.c_str(), i.msg_size, i.msg_count,
+               (int) i.pid, created, i.attached);
+    }
+    std::cout << all.size() << " objects, listed in " << us << " us" << std::endl;
+    return 0;
+}
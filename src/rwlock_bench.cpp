@@ -0,0 +1,71 @@
+// Read throughput and write latency of Variable modes under a read-heavy load.
+//
+// `readers` threads read the variable in a loop while one writer writes it every
+// `period` microseconds; the writer measures how long each write() call takes.
+//
+// usage: rwlock_bench [readers] [seconds] [size] [period us]
+
+#include "../lib/topic.hpp"
+#include "../lib/histogram.hpp"
+#include <cstdio>
+#include <chrono>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+void bench(const char *title, Variable::Mode mode, ui readers, ui seconds, ui size, ui period) {
+    std::string name = "/clap_rwlock_bench";
+    Variable::remove(name);
+    auto var = Variable::create(name, size, mode);
+    if (nullptr == var) {
+        std::cout << "Cannot create variable " << name << std::endl;
+        return;
+    }
+    std::atomic<bool> stop(false);
+    std::atomic<ui> reads(0);
+    std::vector<std::thread> threads;
+    for (ui i = 0; i < readers; i++)
+        threads.emplace_back([&]() {
+            auto v = Variable::just_open(name, size, mode);
+            std::vector<char> buf(size);
+            ui n = 0;
+            while (!stop.load(std::memory_order_relaxed))
+                if (v->read(buf.data())) n++;
+            reads += n;
+        });
+    tpc::Histogram hist;
+    std::vector<char> buf(size, 1);
+    auto end = Clock::now() + std::chrono::seconds(seconds);
+    while (Clock::now() < end && !tpc::interrupted) {
+        auto t0 = Clock::now();
+        var->write(buf.data());
+        hist.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+        std::this_thread::sleep_for(std::chrono::microseconds(period));
+    }
+    stop = true;
+    for (auto &t : threads) t.join();
+    std::cout << title << ": reads/s=" << reads / seconds << ", write latency:" << std::endl;
+    hist.print(std::cout, "us", 1000.0);
+    Variable::remove(name);
+}
+
+int main(int argc, char **args) {
+    ui readers = 4;
+    ui seconds = 3;
+    ui size = 4096;
+    ui period = 1000;
+    if (argc > 1) sscanf(args[1], "%lu", &readers);
+    if (argc > 2) sscanf(args[2], "%lu", &seconds);
+    if (argc > 3) sscanf(args[3], "%lu", &size);
+    if (argc > 4) sscanf(args[4], "%lu", &period);
+    if (0 == seconds || 0 == size) {
+        std::cout << "seconds and size should be > 0" << std::endl;
+        return 1;
+    }
+    tpc::init_system();
+    bench("rwlock", Variable::rwlock, readers, seconds, size, period);
+    bench("fair_rwlock", Variable::fair_rwlock, readers, seconds, size, period);
+    bench("seqlock", Variable::seqlock, readers, seconds, size, period);
+    bench("multibuffer", Variable::multibuffer, readers, seconds, size, period);
+    return 0;
+}
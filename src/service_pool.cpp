@@ -0,0 +1,34 @@
+#include <iostream>
+#include <cstdio>
+#include "../lib/topic.hpp"
+
+// Same service as service_serv, answered by a pool of workers
+// usage: service_pool [threads] [processes]
+
+template<typename T>
+struct Question {
+    T x = 0;
+    T y = 0;
+};
+
+int main(int argc, char **args) {
+    ui threads = std::thread::hardware_concurrency();
+    ui processes = 1;
+    if (argc > 1) sscanf(args[1], "%lu", &threads);
+    if (argc > 2) sscanf(args[2], "%lu", &processes);
+    tpc::init_system();
+    std::string service_name = "/clap0";
+    auto s = service::create_async_server<8, 4>(service_name, 10, 10);
+    if (nullptr == s) {
+        std::cout << "Server wasnt created" << std::endl;
+        return 1;
+    }
+    std::cout << " Starting serve: threads=" << threads << " processes=" << processes << std::endl;
+    s->serve([](service::util::Request<8, 4> &q) {
+        if (sizeof(Question<int>) < q.size()) return;
+        auto msg = (Question<int>*) q.data();
+        int result = msg->x + msg->y;
+        q.answer(&result, sizeof(int));
+    }, threads, processes);
+    return 0;
+}
@@ -0,0 +1,10 @@
+#include <iostream>
+#include "../lib/topic.hpp"
+
+int main() {
+    std::string service_name = "/clap0";
+    if (service::remove(service_name)) {
+        std::cout << "Service : " << service_name << " removed" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,456 @@
+// Forwards topics to another host over TCP.
+//
+// `forward` subscribes to local topics and sends their messages to a `serve` bridge, which
+// republishes them into topics of the same names (created when missing, prefix see topic_replay).
+// Every topic gets a reader thread that takes batches of published messages and sends each batch
+// with one writev; Nagle is off, so a batch leaves at once. Messages carry the topic sequence
+// number, so the serving side counts the ones overwritten before the forwarder read them as lost.
+// It counts per connection, as several forwarders may feed one topic; messages published while
+// the link was down are the forwarder's `unsent`. The forwarder reconnects on its own.
+//
+// Both ends must share the byte order, the stream starts with a magic that checks it.
+//
+// usage: topic_bridge serve <port> [prefix]
+//        topic_bridge forward <host> <port> <topic> [topic ...]
+
+#include "../lib/topic.hpp"
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <list>
+#include <map>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+static const ui BATCH = 256;
+static const long POLL_US = 100000;
+static const ui RECV_BUF = 1 << 20;
+static const uint64_t MAGIC = 0x3147524250414c43; // "CLAPBRG1"
+static const ui MAX_NAME = 255;
+
+enum : uint16_t { FRAME_MSG = 0, FRAME_TOPIC = 1 };
+
+// Followed by `size` bytes: the message, or for FRAME_TOPIC a TopicDesc and the name
+struct Frame {
+    uint16_t kind;
+    uint16_t topic;
+    uint32_t size;
+    ui seq;
+};
+
+struct TopicDesc {
+    ui msg_size;
+    ui msg_count;
+};
+
+static void set_options(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+}
+
+static bool write_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (-1 == n) {
+            if (EINTR == errno) continue;
+            return false;
+        }
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+static void block_stop_signals(sigset_t *old) {
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, old);
+}
+
+// Forwarding side
+
+struct Link {
+    std::mutex mutex;
+    std::atomic<int> fd{-1};
+    std::atomic<ui> sent{0}, bytes{0}, unsent{0};
+    ui connects = 0;
+
+    void drop() {
+        int f = fd.exchange(-1);
+        if (-1 != f) close(f);
+    }
+};
+
+struct Forwarded {
+    Topic::Ptr topic;
+    uint16_t id;
+    std::atomic<ui> dropped{0};
+};
+
+static int connect_to(const char *host, const char *port) {
+    struct addrinfo hints = {}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (0 != getaddrinfo(host, port, &hints, &res)) return -1;
+    int fd = -1;
+    for (auto a = res; nullptr != a && -1 == fd; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (-1 == fd) continue;
+        if (0 != connect(fd, a->ai_addr, a->ai_addrlen)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (-1 != fd) set_options(fd);
+    return fd;
+}
+
+// Magic, then one FRAME_TOPIC per topic
+static bool greet(int fd, std::vector<std::unique_ptr<Forwarded>> &topics) {
+    std::vector<char> hello(sizeof(MAGIC));
+    memcpy(hello.data(), &MAGIC, sizeof(MAGIC));
+    for (auto &f : topics) {
+        auto &name = f->topic->get_name();
+        Frame fr = {FRAME_TOPIC, f->id, (uint32_t) (sizeof(TopicDesc) + name.size()), 0};
+        TopicDesc d = {f->topic->get_msg_size(), f->topic->get_msg_count()};
+        hello.insert(hello.end(), (char *) &fr, (char *) (&fr + 1));
+        hello.insert(hello.end(), (char *) &d, (char *) (&d + 1));
+        hello.insert(hello.end(), name.begin(), name.end());
+    }
+    struct iovec iov = {hello.data(), hello.size()};
+    return write_all(fd, &iov, 1);
+}
+
+static int forward(const char *host, const char *port, int count, char **names) {
+    std::vector<std::unique_ptr<Forwarded>> topics;
+    for (int i = 0; i < count; i++) {
+        std::unique_ptr<Forwarded> f(new Forwarded());
+        f->topic = Topic::spawn(names[i]);
+        if (nullptr == f->topic) {
+            std::cout << "Cannot open topic " << names[i] << std::endl;
+            return 1;
+        }
+        f->id = (uint16_t) i;
+        topics.push_back(std::move(f));
+    }
+    Link link;
+    sigset_t old;
+    block_stop_signals(&old);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (auto &f : topics)
+        threads.emplace_back([&link, &stop](Forwarded *f) {
+            ui size = f->topic->get_msg_size();
+            std::vector<char> buf(size * BATCH);
+            std::vector<Topic::MsgInfo> infos(BATCH);
+            std::vector<Frame> frames(BATCH);
+            std::vector<struct iovec> iov(2 * BATCH);
+            while (!stop.load(std::memory_order_relaxed)) {
+                ui n = f->topic->sub_batch_info(buf.data(), BATCH, infos.data(), POLL_US);
+                f->dropped.store(f->topic->get_dropped(), std::memory_order_relaxed);
+                if (0 == n) continue;
+                ui bytes = 0;
+                for (ui i = 0; i < n; i++) {
+                    frames[i] = Frame{FRAME_MSG, f->id, (uint32_t) infos[i].size, infos[i].seq};
+                    iov[2 * i] = {&frames[i], sizeof(Frame)};
+                    iov[2 * i + 1] = {buf.data() + i * size, infos[i].size};
+                    bytes += sizeof(Frame) + infos[i].size;
+                }
+                std::lock_guard<std::mutex> l(link.mutex);
+                int fd = link.fd;
+                if (-1 != fd && write_all(fd, iov.data(), (int) (2 * n))) {
+                    link.sent += n;
+                    link.bytes += bytes;
+                } else {
+                    if (-1 != fd) link.drop();
+                    link.unsent += n;
+                }
+            }
+        }, f.get());
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+
+    // Reconnects with backoff; the serving side never writes, so a readable socket means it is gone
+    long backoff_ms = 100;
+    auto next_try = std::chrono::steady_clock::now();
+    auto next_stats = next_try + std::chrono::seconds(1);
+    ui last = 0;
+    while (!tpc::interrupted) {
+        auto now = std::chrono::steady_clock::now();
+        int fd = link.fd;
+        if (-1 == fd && now >= next_try) {
+            fd = connect_to(host, port);
+            if (-1 != fd && !greet(fd, topics)) {
+                close(fd);
+                fd = -1;
+            }
+            if (-1 == fd) {
+                next_try = now + std::chrono::milliseconds(backoff_ms);
+                backoff_ms = std::min(backoff_ms * 2, 2000L);
+            } else {
+                std::lock_guard<std::mutex> l(link.mutex);
+                link.fd = fd;
+                link.connects++;
+                backoff_ms = 100;
+                std::cout << "connected to " << host << ":" << port << std::endl;
+            }
+        }
+        if (-1 != fd) {
+            struct pollfd p = {fd, POLLIN, 0};
+            if (poll(&p, 1, 100) > 0) {
+                std::lock_guard<std::mutex> l(link.mutex);
+                if (link.fd == fd) {
+                    link.drop();
+                    std::cout << "disconnected" << std::endl;
+                }
+            }
+        } else std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() >= next_stats) {
+            next_stats += std::chrono::seconds(1);
+            ui sent = link.sent, dropped = 0;
+            for (auto &f : topics) dropped += f->dropped;
+            std::cout << "sent=" << sent << " (" << sent - last << "/s) bytes=" << link.bytes
+                      << " unsent=" << link.unsent << " dropped=" << dropped << std::endl;
+            last = sent;
+        }
+    }
+    stop = true;
+    int fd = link.fd;
+    if (-1 != fd) shutdown(fd, SHUT_RDWR);
+    for (auto &t : threads) t.join();
+    link.drop();
+    std::cout << "sent " << link.sent << " messages, " << link.bytes << " bytes, " << link.unsent
+              << " unsent, " << link.connects << " connections" << std::endl;
+    return 0;
+}
+
+// Serving side
+
+// Shared by the forwarders of a topic, which publish through handles of their own
+struct Served {
+    Topic::Ptr topic;
+    std::atomic<ui> received{0}, lost{0};
+};
+
+// A topic of one forwarder connection
+struct Inbound {
+    Served *served = nullptr;
+    Topic::Ptr topic;
+    ui next_seq = 0;
+    bool seen = false;
+    bool rejected = false;      // announced, but there is no local topic to take its messages
+};
+
+// A forwarder connection, its thread is joined once it is done
+struct Connection {
+    std::thread thread;
+    std::atomic<bool> done{false};
+};
+
+struct Server {
+    std::string prefix;
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Served>> topics;
+    std::atomic<ui> rejected{0};    // messages of rejected topics, counted as lost
+    std::atomic<bool> stop{false};
+
+    // Marks `in` rejected when the topic can't be opened
+    bool open(const std::string &name, const TopicDesc &d, Inbound &in) {
+        in = Inbound();
+        in.rejected = true;
+        std::string local = '/' == name[0] ? "/" + prefix + name.substr(1) : prefix + name;
+        std::lock_guard<std::mutex> l(mutex);
+        auto &s = topics[local];
+        if (nullptr == s) {
+            auto t = Topic::spawn(local);
+            if (nullptr == t) t = Topic::spawn_create(local, d.msg_size, d.msg_count);
+            if (nullptr == t || t->get_msg_size() < d.msg_size) {
+                std::cout << "Cannot open topic " << local << " for messages of " << d.msg_size << " bytes" << std::endl;
+                topics.erase(local);
+                return false;
+            }
+            s.reset(new Served());
+            s->topic = t;
+        }
+        in.topic = Topic::spawn(local);
+        if (nullptr == in.topic) return false;
+        in.served = s.get();
+        in.rejected = false;
+        return true;
+    }
+
+    // Parses frames from one forwarder until it disconnects
+    void run(int fd) {
+        std::vector<char> buf(RECV_BUF);
+        std::vector<Inbound> by_id;
+        ui len = 0, skip = 0;   // skip - rest of a rejected topic's message, dropped as it arrives
+        bool greeted = false;
+        while (!stop) {
+            struct pollfd p = {fd, POLLIN, 0};
+            if (poll(&p, 1, 100) <= 0) continue;
+            ssize_t n = recv(fd, buf.data() + len, buf.size() - len, 0);
+            if (n <= 0) {
+                if (-1 == n && EINTR == errno) continue;
+                break;
+            }
+            len += n;
+            ui pos = 0;
+            if (!greeted) {
+                if (len < sizeof(MAGIC)) continue;
+                if (0 != memcmp(buf.data(), &MAGIC, sizeof(MAGIC))) {
+                    std::cout << "Bad magic from forwarder" << std::endl;
+                    break;
+                }
+                greeted = true;
+                pos = sizeof(MAGIC);
+            }
+            if (skip > 0) {
+                pos = std::min(skip, len);
+                skip -= pos;
+            }
+            bool bad = false;
+            while (len - pos >= sizeof(Frame)) {
+                Frame f;
+                memcpy(&f, buf.data() + pos, sizeof(f));
+                // Sizes are checked before the buffer grows to take the frame
+                if (FRAME_TOPIC == f.kind) {
+                    if (f.size < sizeof(TopicDesc) || f.size > sizeof(TopicDesc) + MAX_NAME) {
+                        bad = true;
+                        break;
+                    }
+                } else if (f.topic < by_id.size() && by_id[f.topic].rejected) {
+                    // Other topics of the connection go on, a message that didn't arrive whole is skipped later
+                    ui n = std::min((ui) f.size, len - pos - (ui) sizeof(Frame));
+                    pos += sizeof(Frame) + n;
+                    skip = f.size - n;
+                    rejected++;
+                    continue;
+                } else if (f.topic >= by_id.size() || nullptr == by_id[f.topic].served
+                           || f.size > by_id[f.topic].topic->get_msg_size()) {
+                    bad = true;
+                    break;
+                }
+                if (len - pos - sizeof(Frame) < f.size) {
+                    if (sizeof(Frame) + f.size > buf.size()) buf.resize(sizeof(Frame) + f.size);
+                    break;
+                }
+                const char *data = buf.data() + pos + sizeof(Frame);
+                pos += sizeof(Frame) + f.size;
+                if (FRAME_TOPIC == f.kind) {
+                    TopicDesc d;
+                    memcpy(&d, data, sizeof(d));
+                    if (f.topic >= by_id.size()) by_id.resize(f.topic + 1);
+                    open(std::string(data + sizeof(d), f.size - sizeof(d)), d, by_id[f.topic]);
+                    continue;
+                }
+                Inbound &in = by_id[f.topic];
+                if (in.seen && f.seq > in.next_seq) in.served->lost += f.seq - in.next_seq;
+                in.seen = true;
+                in.next_seq = f.seq + 1;
+                in.topic->pub(data, f.size);
+                in.served->received++;
+            }
+            if (bad) {
+                std::cout << "Bad frame from forwarder" << std::endl;
+                break;
+            }
+            memmove(buf.data(), buf.data() + pos, len - pos);
+            len -= pos;
+        }
+        close(fd);
+    }
+};
+
+static int serve(const char *port, const std::string &prefix) {
+    int lfd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1, zero = 0;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(lfd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+    struct sockaddr_in6 addr = {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons((uint16_t) atoi(port));
+    if (-1 == lfd || 0 != bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) || 0 != listen(lfd, 16)) {
+        std::cout << "Cannot listen on port " << port << std::endl;
+        return 1;
+    }
+    Server server;
+    server.prefix = prefix;
+    std::list<std::unique_ptr<Connection>> connections;
+    auto next_stats = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    ui last = 0;
+    while (!tpc::interrupted) {
+        for (auto c = connections.begin(); c != connections.end();) {
+            if (!(*c)->done) {
+                ++c;
+                continue;
+            }
+            (*c)->thread.join();
+            c = connections.erase(c);
+        }
+        struct pollfd p = {lfd, POLLIN, 0};
+        if (poll(&p, 1, 100) > 0) {
+            int fd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (-1 != fd) {
+                set_options(fd);
+                sigset_t old;
+                block_stop_signals(&old);
+                std::unique_ptr<Connection> c(new Connection());
+                Connection *cp = c.get();
+                c->thread = std::thread([&server, cp, fd] {
+                    server.run(fd);
+                    cp->done = true;
+                });
+                connections.push_back(std::move(c));
+                pthread_sigmask(SIG_SETMASK, &old, nullptr);
+            }
+        }
+        if (std::chrono::steady_clock::now() >= next_stats) {
+            next_stats += std::chrono::seconds(1);
+            ui received = 0, lost = server.rejected;
+            {
+                std::lock_guard<std::mutex> l(server.mutex);
+                for (auto &s : server.topics) {
+                    received += s.second->received;
+                    lost += s.second->lost;
+                }
+            }
+            std::cout << "received=" << received << " (" << received - last << "/s) lost=" << lost << std::endl;
+            last = received;
+        }
+    }
+    server.stop = true;
+    for (auto &c : connections) c->thread.join();
+    close(lfd);
+    for (auto &s : server.topics)
+        std::cout << s.first << ": received=" << s.second->received << " lost=" << s.second->lost << std::endl;
+    if (0 != server.rejected) std::cout << "rejected topics: lost=" << server.rejected << std::endl;
+    return 0;
+}
+
+int main(int argc, char **args) {
+    tpc::init_system();
+    signal(SIGPIPE, SIG_IGN);
+    if (argc >= 3 && std::string("serve") == args[1])
+        return serve(args[2], argc > 3 ? args[3] : "");
+    if (argc >= 5 && std::string("forward") == args[1])
+        return forward(args[2], args[3], argc - 4, args + 4);
+    std::cout << "usage: topic_bridge serve <port> [prefix]" << std::endl;
+    std::cout << "       topic_bridge forward <host> <port> <topic> [topic ...]" << std::endl;
+    return 1;
+}
@@ -0,0 +1,91 @@
+// Drains topics into files and TCP sockets from one thread (lib/drain.hpp) until interrupted.
+//
+// Outputs are streams of capture records (capture::Record + message padded to 8 bytes) with the
+// position of the pair on the command line as topic id. An output is a file path or tcp:host:port.
+// `uring` uses io_uring when the kernel allows it, `writev` forces the epoll/writev engine.
+//
+// usage: topic_drain <uring|writev> <topic> <output> [<topic> <output> ...]
+
+#include "../lib/drain.hpp"
+#include <chrono>
+#include <thread>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+static int open_output(const std::string &out) {
+    if (0 != out.compare(0, 4, "tcp:")) return open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    auto colon = out.rfind(':');
+    if (colon <= 4) return -1;
+    std::string host = out.substr(4, colon - 4), port = out.substr(colon + 1);
+    struct addrinfo hints = {}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (0 != getaddrinfo(host.c_str(), port.c_str(), &hints, &res)) return -1;
+    int fd = -1;
+    for (auto a = res; nullptr != a && -1 == fd; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (-1 == fd) continue;
+        if (0 != connect(fd, a->ai_addr, a->ai_addrlen)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int main(int argc, char **args) {
+    if (argc < 4 || 0 != argc % 2 || (std::string("uring") != args[1] && std::string("writev") != args[1])) {
+        std::cout << "usage: topic_drain <uring|writev> <topic> <output> [<topic> <output> ...]" << std::endl;
+        return 1;
+    }
+    tpc::init_system();
+    signal(SIGPIPE, SIG_IGN);
+    std::vector<tpc::DrainEngine::Target> targets;
+    for (int i = 2; i < argc; i += 2) {
+        auto topic = Topic::spawn(args[i]);
+        if (nullptr == topic) {
+            std::cout << "Cannot open topic " << args[i] << std::endl;
+            return 1;
+        }
+        int fd = open_output(args[i + 1]);
+        if (-1 == fd) {
+            std::cout << "Cannot open output " << args[i + 1] << std::endl;
+            return 1;
+        }
+        targets.push_back({topic, fd, (uint32_t) targets.size()});
+    }
+    auto engine = tpc::DrainEngine::create(targets, 1024, 4, std::string("uring") == args[1]);
+    if (nullptr == engine) {
+        std::cout << "Cannot start drain engine" << std::endl;
+        return 1;
+    }
+    std::cout << (engine->uses_uring() ? engine->uses_fixed_buffers() ? "io_uring, registered buffers"
+                                                                      : "io_uring" : "epoll/writev") << std::endl;
+
+    auto next_stats = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    ui last = 0;
+    long sleep_us = 10;
+    while (!tpc::interrupted && !engine->failed()) {
+        if (0 != engine->poll()) sleep_us = 10;
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
+            sleep_us = std::min(sleep_us * 2, 1000L);
+        }
+        if (std::chrono::steady_clock::now() >= next_stats) {
+            next_stats += std::chrono::seconds(1);
+            ui messages = engine->get_messages();
+            std::cout << "messages=" << messages << " (" << messages - last << "/s) bytes=" << engine->get_bytes()
+                      << " dropped=" << engine->get_dropped() << std::endl;
+            last = messages;
+        }
+    }
+    tpc::interrupted = false;
+    engine->flush();
+    for (auto &t : targets) close(t.fd);
+    std::cout << "drained " << engine->get_messages() << " messages, " << engine->get_bytes() << " bytes, "
+              << engine->get_dropped() << " dropped" << std::endl;
+    return engine->failed() ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+// Records messages of existing topics into a capture log (lib/capture.hpp) until interrupted.
+//
+// Every topic gets its own reader thread that takes batches of already published messages,
+// so the publisher only ever waits for one memcpy of a slot; a reader that still falls a lap
+// behind loses messages, which are counted from the gaps in sequence numbers.
+//
+// usage: topic_record <dir> <segment MB> <topic> [topic ...]
+
+#include "../lib/capture.hpp"
+#include <cstdio>
+#include <chrono>
+#include <thread>
+
+static const ui BATCH = 256;
+static const long POLL_US = 100000;
+
+struct Recorded {
+    Topic::Ptr topic;
+    uint32_t id;
+    std::atomic<ui> dropped{0};
+};
+
+int main(int argc, char **args) {
+    if (argc < 4) {
+        std::cout << "usage: topic_record <dir> <segment MB> <topic> [topic ...]" << std::endl;
+        return 1;
+    }
+    ui segment_mb = 0;
+    sscanf(args[2], "%lu", &segment_mb);
+    if (0 == segment_mb) {
+        std::cout << "segment size should be > 0" << std::endl;
+        return 1;
+    }
+    tpc::init_system();
+    auto log = tpc::CaptureWriter::create(args[1], segment_mb << 20);
+    if (nullptr == log) {
+        std::cout << "Cannot create capture log in " << args[1] << std::endl;
+        return 1;
+    }
+    std::vector<std::unique_ptr<Recorded>> topics;
+    for (int i = 3; i < argc; i++) {
+        std::unique_ptr<Recorded> r(new Recorded());
+        r->topic = Topic::spawn(args[i]);
+        if (nullptr == r->topic) {
+            std::cout << "Cannot open topic " << args[i] << std::endl;
+            return 1;
+        }
+        r->id = log->add_topic(args[i], r->topic->get_msg_size());
+        topics.push_back(std::move(r));
+    }
+
+    // Readers run with signals blocked, so SIGINT reaches the main thread
+    sigset_t stop_signals, old;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (auto &r : topics)
+        threads.emplace_back([&log, &stop](Recorded *r) {
+            ui size = r->topic->get_msg_size();
+            std::vector<char> buf(size * BATCH);
+            std::vector<Topic::MsgInfo> infos(BATCH);
+            while (!stop.load(std::memory_order_relaxed)) {
+                ui n = r->topic->sub_batch_info(buf.data(), BATCH, infos.data(), POLL_US);
+                if (n > 0 && !log->append(r->id, buf.data(), size, infos.data(), n)) stop = true;
+                r->dropped.store(r->topic->get_dropped(), std::memory_order_relaxed);
+            }
+        }, r.get());
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+
+    ui last = 0;
+    while (!tpc::interrupted && !stop) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        ui records = log->get_records(), dropped = 0;
+        for (auto &r : topics) dropped += r->dropped;
+        std::cout << "records=" << records << " (" << records - last << "/s) bytes=" << log->get_bytes()
+                  << " dropped=" << dropped << std::endl;
+        last = records;
+    }
+    stop = true;
+    for (auto &t : threads) t.join();
+    for (auto &r : topics)
+        std::cout << r->topic->get_name() << ": dropped=" << r->dropped << std::endl;
+    std::cout << "recorded " << log->get_records() << " messages, " << log->get_bytes() << " bytes" << std::endl;
+    return 0;
+}
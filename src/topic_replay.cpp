@@ -0,0 +1,110 @@
+// Republishes a capture log (lib/capture.hpp, see topic_record) into topics of the same names.
+//
+// speed 1 keeps the recorded intervals between messages, 2 plays twice as fast and so on;
+// speed 0 publishes as fast as the topics take messages. Messages that are due are published
+// in batches of up to `batch` with one clock reading per batch. A batch ends where the log moves
+// to the next segment, as the reader keeps only the current and the previous one mapped.
+// `from` (seconds since the epoch) starts at the first message published at or after it,
+// found through the capture index.
+// `prefix` goes in front of topic names (after the leading '/') to keep a replay apart from
+// live topics: prefix replay_ turns /prices into /replay_prices.
+//
+// usage: topic_replay <dir> [speed] [from s] [prefix] [batch]
+
+#include "../lib/capture.hpp"
+#include <cstdio>
+#include <chrono>
+#include <thread>
+
+static const ui MSG_COUNT = 1024;
+
+static void wait_until(int64_t t) {
+    while (true) {
+        int64_t left = t - tpc::monotonic_ns();
+        if (left <= 0 || tpc::interrupted) return;
+        if (left > 100000) std::this_thread::sleep_for(std::chrono::nanoseconds(left - 50000));
+    }
+}
+
+int main(int argc, char **args) {
+    if (argc < 2) {
+        std::cout << "usage: topic_replay <dir> [speed] [from s] [prefix] [batch]" << std::endl;
+        return 1;
+    }
+    double speed = 1, from = 0;
+    std::string prefix;
+    ui batch = 64;
+    if (argc > 2) sscanf(args[2], "%lf", &speed);
+    if (argc > 3) sscanf(args[3], "%lf", &from);
+    if (argc > 4) prefix = std::string(args[4]);
+    if (argc > 5) sscanf(args[5], "%lu", &batch);
+    if (speed < 0 || 0 == batch) {
+        std::cout << "speed should be >= 0 and batch > 0" << std::endl;
+        return 1;
+    }
+    tpc::init_system();
+    auto log = tpc::CaptureReader::just_open(args[1]);
+    if (nullptr == log) {
+        std::cout << "Cannot open capture log " << args[1] << std::endl;
+        return 1;
+    }
+    std::vector<Topic::Ptr> topics;
+    for (auto &info : log->get_topics()) {
+        std::string name = '/' == info.name[0] ? "/" + prefix + info.name.substr(1) : prefix + info.name;
+        auto t = Topic::spawn(name);
+        if (nullptr == t) t = Topic::spawn_create(name, info.msg_size, MSG_COUNT);
+        if (nullptr == t || t->get_msg_size() < info.msg_size) {
+            std::cout << "Cannot open topic " << name << " for messages of " << info.msg_size << " bytes" << std::endl;
+            return 1;
+        }
+        topics.push_back(t);
+    }
+    if (from > 0 && !log->seek_time((int64_t) (from * 1e9))) {
+        std::cout << "Cannot seek to " << args[3] << std::endl;
+        return 1;
+    }
+
+    struct Due {
+        tpc::capture::Record rec;
+        const char *data;
+        ui segment;
+    };
+    std::vector<Due> due(batch);
+    Due next;
+    bool has_next = false;
+    ui published = 0;
+    bool started = false;
+    int64_t first_ns = 0, start = tpc::monotonic_ns();
+    auto when = [&](const Due &d) {
+        return speed > 0 ? start + (int64_t) ((d.rec.time_ns - first_ns) / speed) : 0;
+    };
+    while (!tpc::interrupted) {
+        // The first message sets when the batch goes out, the following ones join it while they are due by then
+        ui n = 0;
+        if (has_next) due[n++] = next;
+        else if (log->next(due[0].rec, due[0].data)) due[n++].segment = log->get_segment();
+        else break;
+        has_next = false;
+        if (!started) {
+            started = true;
+            first_ns = due[0].rec.time_ns;
+            start = tpc::monotonic_ns();
+        }
+        int64_t at = when(due[0]);
+        while (n < batch && log->next(next.rec, next.data)) {
+            next.segment = log->get_segment();
+            if (when(next) > at || next.segment != due[0].segment) {
+                has_next = true;
+                break;
+            }
+            due[n++] = next;
+        }
+        wait_until(at);
+        for (ui i = 0; i < n && !tpc::interrupted; i++)
+            if (0 != topics[due[i].rec.topic]->pub(due[i].data, due[i].rec.size)) published++;
+    }
+    double secs = (tpc::monotonic_ns() - start) / 1e9;
+    std::cout << "published " << published << " messages in " << secs << " s ("
+              << (secs > 0 ? published / secs : 0) << " msg/s)" << std::endl;
+    return 0;
+}